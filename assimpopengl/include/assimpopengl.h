@@ -24,5 +24,18 @@
 #include "info.h"
 #include "createimage.h"
 #include "shader.h"
+#include "renderqueue.h"
+#include "ringbuffer.h"
+#include "shaderset.h"
+#include "texturestreamer.h"
+#include "texturecache.h"
+#include "mappedfile.h"
+#include "meshcache.h"
+#include "resourcearchive.h"
+#include "textureregistry.h"
+#include "meshoptimizer.h"
+#include "meshpool.h"
+#include "meshsimplifier.h"
+#include "lightclusters.h"
 
 #endif // ASSIMPOPENGL_H
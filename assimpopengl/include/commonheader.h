@@ -90,6 +90,8 @@ struct PointLight {
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
+    //! How far the light reaches, 0 when it reaches everything.
+    float range = 0.0f;
 };
 
 /** \brief A structure to define a spotlight.
@@ -107,6 +109,8 @@ struct SpotLight {
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;       
+    //! How far the light reaches, 0 when it reaches everything.
+    float range = 0.0f;
 };
 
 #endif // COMMONHEADER_H
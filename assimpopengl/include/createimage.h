@@ -11,9 +11,58 @@
 #ifndef CREATEIMAGE_H
 #define CREATEIMAGE_H
 #include "commonheader.h"
+#include "mappedfile.h"
+#include <functional>
+#include <memory>
+
+//! Forward declarations so it can be used as a library.
+class TextureStreamer;
 
 using namespace std;
 
+//! \brief The channel swizzle kernels, SWIZZLE_BEST picks the fastest the CPU has.
+enum SwizzleKernel {
+    SWIZZLE_BEST = -1,
+    SWIZZLE_SCALAR = 0,
+    SWIZZLE_SSSE3 = 1,
+    SWIZZLE_AVX2 = 2
+};
+
+/** \brief An image decoded for upload.  Decoding needs no GL
+ *  context, so it can be done on any thread.  Images with alpha
+ *  are RGBA, opaque ones keep Free Image's BGRA order, which GL
+ *  takes directly.  An image from the texture cache has its whole
+ *  mip chain, in the mapped cache file, and no pixels of its own.
+ */
+struct DecodedImage {
+    string path;
+    GLsizei width = 0;
+    GLsizei height = 0;
+    //! GL_RGBA or GL_BGRA, the pixel format to pass to GL.
+    GLenum format = GL_RGBA;
+    vector<unsigned char> pixels;
+    //! The cached mip chain, level 0 first, and the mapping it lives in.
+    vector<const unsigned char*> levels;
+    shared_ptr<MappedFile> mapping;
+    //! A hash of the source image, zero if it could not be read.
+    GLuint64 key = 0;
+    bool ok = false;
+    //! The pixels of a level, only level 0 unless the image is cached.
+    const unsigned char *level(int x) const
+    {
+        return levels.empty() ? pixels.data() : levels[x];
+    }
+    GLint levelCount() const
+    {
+        return levels.empty() ? 1 : levels.size();
+    }
+    //! The bytes in a level.
+    size_t levelSize(int x) const
+    {
+        return (size_t)std::max(width >> x, 1) * std::max(height >> x, 1) * 4;
+    }
+};
+
 /* \class CreateImage : Using Free Image Plus, this class loads an 
  * image into memory, converts it to a 32 bit format with alpha, 
  * and then passes it to an array of unsigned characters, which 
@@ -33,26 +82,60 @@ public:
     GLsizei getWidth();
     GLsizei getHeight();
     GLvoid *getData();
+    GLenum getFormat();
     //! Return an OpenGL buffer object.
     GLuint textureObject();
+    /** Stream the textures made from now on through the pixel
+     *  buffers of streamer, or upload them at once when null.
+     */
+    void setStreamer(TextureStreamer *streamer);
     //! Return an OpenGL sky box object.
     void createSkyBoxTex(GLuint &textureID, string filenames[6]);
+    //! The same from six faces decoded beforehand.
+    void createSkyBoxTex(GLuint &textureID, const vector<DecodedImage> &faces);
     //! Create an array of images for an OpenGL Texture2DArray object.
     void create2DTexArray(GLuint &textureID, vector<string>filenames);
+    //! The same from layers decoded beforehand.
+    void create2DTexArray(GLuint &textureID, const vector<DecodedImage> &layers);
+    //! Decode one image file to RGBA, safe to call from any thread.
+    static bool decodeImage(const string &imagefile, DecodedImage &image);
+    /** Decode the images whose paths are set, on a pool of worker
+     *  threads, one per core.  Only the GL uploads are left for the
+     *  context thread.
+     */
+    static void decodeAll(vector<DecodedImage> &images);
+    /** Decode the images on the worker threads and hand each one
+     *  to ready() on the calling thread as soon as it is done, in
+     *  the order they finish.  An image is released when ready()
+     *  returns, and the workers only run a little ahead of it, so
+     *  few images are held in memory at once.
+     */
+    static void decodeEach(vector<DecodedImage> &images, const function<void(int)> &ready);
+    /** Swap BGRA pixels to RGBA and clear the colour where alpha
+     *  is zero, with SSSE3 or AVX2 when the CPU has them.  The
+     *  source and destination may be the same.
+     */
+    static void swizzleMask(const unsigned char *src, unsigned char *dst, size_t count, 
+    int kernel = SWIZZLE_BEST);
+    //! The kernel swizzleMask() uses on this CPU.
+    static int bestKernel();
+    /** Upload a decoded image as a mipmapped 2D texture, streamed
+     *  when a streamer is given.
+     */
+    static GLuint textureObject(const DecodedImage &image, TextureStreamer *streamer = nullptr);
 protected:
+    /** Upload one layer of an array texture, allocating the
+     *  texture for the first layer that decoded.
+     */
+    void uploadLayer(GLuint &textureID, const DecodedImage &layer, int i, GLsizei depth,
+    GLsizei &width, GLsizei &height, bool &ok, bool &baked);
+    //! Mipmaps and parameters of an array texture once its layers are in.
+    void finishTexArray(GLuint textureID, bool ok, bool baked);
     //! Class global variables.
-    //! The Free Image Plus image object.
-    fipImage txtImage;
-    //! A line of image data.
-    BYTE *picLine;
-    //! Image dimensions.
-    GLsizei width;
-    GLsizei height;
-    int size = 0;
-    //! Image data.
-    unsigned char *pixels = NULL;
-    //! Line and byte counters.
-    int count, line;
+    //! The last image set with setImage(), kept for the accessors.
+    DecodedImage image;
+    //! The pixel buffer uploader, if any.
+    TextureStreamer *streamer = nullptr;
     //! A little tiny bit of debug info.
     bool debug1 = false;
 };
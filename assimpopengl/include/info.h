@@ -30,7 +30,10 @@ struct ModelInfo {
     vector<MeshInfo> meshes;
     mat4 model;
     vec3 location;
-    int dist = 0;
+    //! The largest scale of the model matrix, for choosing the levels of detail.
+    float scale = 1.0f;
+    //! The distance from the camera, for the draw order and the levels of detail.
+    float dist = 0.0f;
     int idval = 0;
 };
 
@@ -0,0 +1,112 @@
+/**********************************************************
+ *   LightClusters:  A class to split the view into clusters
+ *   and list, for each cluster, the lights that reach into
+ *   it, so a fragment is lit only by the lights near it.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include "commonheader.h"
+#include "ringbuffer.h"
+#include "renderqueue.h"
+#include "shader.h"
+
+//! The clusters across, down and in depth, as in the shaders.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+//! The light array sizes of the light block, as in the shaders.
+#define CLUSTER_POINT_LIGHTS 64
+#define CLUSTER_SPOT_LIGHTS 32
+//! The light indices in a row of the index texture, and the rows.
+#define CLUSTER_INDEX_WIDTH 1024
+#define CLUSTER_INDEX_ROWS 64
+//! The uniform block binding point of the light block.
+#define LIGHT_BLOCK_BINDING 1
+//! The texture units of the cluster grid and the light indices, past the ones the render queue binds.
+#define CLUSTER_GRID_UNIT QUEUE_TEXTURE_UNITS
+#define CLUSTER_INDEX_UNIT (QUEUE_TEXTURE_UNITS + 1)
+
+/** \brief The "LightData" uniform block of the clustered shaders,
+ *  it must match the block declared in them.  The scale holds the
+ *  viewport width and height, the near plane, and the depth slices
+ *  per unit of the log of the depth.
+ */
+struct LightBlock {
+    vec4 clusterScale;
+    PointLightBlock pointLights[CLUSTER_POINT_LIGHTS];
+    SpotLightBlock spotLights[CLUSTER_SPOT_LIGHTS];
+};
+
+/** \class LightClusters The view is split into CLUSTER_X by
+ *  CLUSTER_Y tiles, each cut into CLUSTER_Z slices that grow with
+ *  the depth.  Every frame each light is bounded by the box around
+ *  the sphere of its range, and added to the list of every cluster
+ *  in the box.  A light of range 0 reaches every cluster.  The
+ *  lists go up in two integer textures, read with texelFetch(),
+ *  since OpenGL ES 3.0 shaders have no buffer textures:  the grid
+ *  holds the first index, the point light and the spot light
+ *  counts of each cluster, the index texture the lists one after
+ *  the other, the point lights of a cluster before its spot
+ *  lights.  The textures are used in turn over RING_REGIONS
+ *  frames, so a frame's upload does not wait on the draws of the
+ *  frame before.
+ */
+class LightClusters
+{
+public:
+    //! \brief Create the textures.
+    LightClusters();
+    //! \brief Delete the textures.
+    ~LightClusters();
+    /** \brief Build and upload the cluster lists of a frame.  Lights
+     *  past the block sizes are dropped.
+     */
+    void update(const mat4 &view, const mat4 &projection, int width, int height,
+    const vector<PointLight> &lights, const vector<SpotLight> &spotLights);
+    /** \brief Write the light block into the ring, between its
+     *  beginFrame() and flush().  Returns the offset, or -1 if the
+     *  region is full.
+     */
+    GLintptr writeBlock(RingBuffer *ring);
+    //! \brief Bind the frame's textures on their units.
+    void bindTextures();
+    //! \brief Point a clustered program's block and samplers at their binding and units.
+    static void setupShader(Shader *shader);
+    //! \brief Print how full the clusters of the last frame were.
+    void printStats();
+protected:
+    /** \brief The clusters the sphere of a light's range may reach,
+     *  the lowest cluster and the highest, x, y and z.  False, and
+     *  no clusters, when it is out of the view.  A range of 0
+     *  reaches all of them.
+     */
+    bool clusterBounds(const vec3 &position, float range, int *bound);
+    //! \brief The depth slice of a distance in front of the camera.
+    int depthSlice(float depth);
+    //! \brief Count a light in the clusters of its bounds.
+    void countLight(const int *bound, vector<GLuint> &counts);
+    //! \brief Nearest filtering and no mipmaps, as integer textures need.
+    static void integerSampling();
+    GLuint gridTextures[RING_REGIONS], indexTextures[RING_REGIONS];
+    int current = 0;
+    LightBlock block;
+    mat4 view, projection;
+    float nearPlane = 0.1f, farPlane = 1.0f, sliceScale = 1.0f;
+    //! The bounds of each light, points first, the lower then the upper cluster.
+    vector<int> bounds;
+    //! Per cluster its point and spot light counts, and the indices written so far.
+    vector<GLuint> pointCounts, spotCounts, filled;
+    //! The texels of the grid and the index list.
+    vector<GLuint> grid, indices;
+    //! Stats of the last frame.
+    GLuint indexCount = 0, largest = 0, dropped = 0;
+    //! Debug output.
+    bool debug1 = false;
+};
+
+#endif // LIGHTCLUSTERS_H
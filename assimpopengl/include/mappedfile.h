@@ -0,0 +1,43 @@
+/**********************************************************
+ *   MappedFile:  A class to map a file read only into
+ *   memory, so cached data is used in place rather than
+ *   read and copied.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "commonheader.h"
+
+/** \class MappedFile A read only memory map of a whole file.
+ *  The mapping lasts as long as the object, it is shared
+ *  through a shared_ptr by whatever points into it.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    //! \brief Unmap the file.
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+    //! \brief Map the file, false if it cannot be opened or is empty.
+    bool open(const string &file);
+    //! \brief Unmap the file, if one is mapped.
+    void close();
+    //! \brief The first byte and the size of the mapping.
+    const unsigned char *data() const;
+    size_t size() const;
+    bool isOpen() const;
+    /** \brief Ask the kernel to read the whole file in now, in one
+     *  sequential pass, rather than a page at a time on first touch.
+     */
+    void willNeed() const;
+protected:
+    void *base = nullptr;
+    size_t length = 0;
+};
+
+#endif // MAPPEDFILE_H
@@ -16,12 +16,17 @@
 
 #include "commonheader.h"
 #include "shader.h"
+#include "renderqueue.h"
+#include "shaderset.h"
+#include "meshpool.h"
+#include "meshsimplifier.h"
 
 //! Forward declarations so it can be used as a library.
 struct Vertex;
 struct Vertex1;
 struct PointLight;
 struct SpotLight;
+
 /** \class Mesh A class that is a base class for the two classes
  * MeshTex (textured meshes) and MeshVert (untextured meshes).
  */
@@ -36,8 +41,35 @@ public:
     void setData(Vertex *vertices, GLuint *indices, GLuint texture, int vertSize, int indexSize, int texSize);
     //! \brief Set data for MeshVert.
     void setData(Vertex1 *vertices, GLuint *indices, int vertSize, int indexSize);
-    //! \brief A virtual function implemented and used by both classes.
-    virtual void Draw(Shader *shader, glm::mat4 view, glm::mat4 projection, glm::mat4 model, vector<PointLight> lights, vector<SpotLight>spotLights, vec3 viewPos, int startIndex = 0, bool diffOnly = true);
+    /** \brief Set the uniforms that belong to this mesh alone,
+     *  the camera and the lights come from the FrameData block
+     *  the caller binds, see Model::Draw().  A null model matrix
+     *  means the draw is instanced and the matrices come from the
+     *  instance buffer.  The meshes are drawn through the render
+     *  queue, see fillItem().
+     */
+    virtual void setUniforms(Shader *shader, const glm::mat4 *model, int startIndex = 0);
+    /** \brief Attach a buffer of per instance model matrices to
+     *  the vertex array, at attribute locations 4 to 7, starting
+     *  offset bytes into the buffer.  A pooled mesh shares its
+     *  vertex array, so it is left alone, the caller gives the
+     *  instanced draw its own array (MeshPool::createVertexArray()).
+     */
+    virtual void setInstanceBuffer(GLuint buffer, GLintptr offset = 0);
+    /** \brief Fill in the vertex array, textures and draw
+     *  parameters of a render queue item, drawing the given level
+     *  of detail.
+     */
+    virtual void fillItem(RenderItem &item, int startIndex = 0, int lod = 0);
+    /** \brief The per draw record of the mesh for a multi draw,
+     *  the uniforms of setUniforms() other than the samplers.  The
+     *  model matrix is left to the caller.
+     */
+    virtual void fillDrawData(DrawData &data);
+    /** \brief The shader features this mesh needs, a mask of
+     *  ShaderFeature values, used to pick its shader variant.
+     */
+    virtual GLuint getFeatures(bool diffOnly = true);
     //! \brief A convenience function to pass messages.
     string getType();
     //! \brief A convenience function to post messages.
@@ -50,6 +82,68 @@ public:
     string type;
     //! \brief The object's opaqueness.
     float opacity;
+    //! \brief The shader variant chosen for this mesh at load time, if any.
+    Shader *program = nullptr;
+    /** \brief The pool the mesh is put in when it is set up, if
+     *  any, otherwise it has buffers and a vertex array of its own.
+     */
+    MeshPool *pool = nullptr;
+    /** \brief Leave setupMesh() to the caller, so the mesh can be
+     *  built on a thread without the GL context and uploaded later.
+     */
+    bool deferSetup = false;
+    //! \brief Set the texture object of one of the mesh's textures, once it is uploaded.
+    virtual void setTextureId(int index, GLuint id);
+    /** \brief The levels of detail, level 0 the full mesh.  Their
+     *  indices follow one another in the index array, and the index
+     *  size counts them all.  Empty when the mesh has no levels.
+     */
+    vector<MeshLod> lods;
+    //! \brief The level to draw when one object unit covers pixelsPerUnit pixels.
+    int selectLod(float pixelsPerUnit);
+    //! \brief The pool arena of the mesh, -1 when it has its own buffers.
+    int getArena();
+    //! \brief Point the instance attributes of a vertex array at a buffer.
+    static void instanceAttributes(GLuint vao, GLuint buffer, GLintptr offset);
+    /** \brief Upload the meshes built from now on in the packed
+     *  layout, off unless turned on.  A packed mesh has to be drawn
+     *  with its PACKED_VERTICES variant, see getFeatures(), which
+     *  holds from when the mesh is built, before it is uploaded.
+     */
+    static void setPacking(bool packing);
+    static bool isPacking();
+    //! \brief Encode a unit vector as two octahedral signed normalized values.
+    static void packDirection(const float *direction, GLshort *packed);
+protected:
+    /** \brief Put the vertices and indices in the pool, or in
+     *  buffers of their own, and set the vertex array to draw them.
+     */
+    void uploadMesh(int layout, const GLvoid *vertices, int vertSize, const GLuint *indices,
+    int indexSize, GLuint &VAO, GLuint &VBO, GLuint &EBO);
+    //! \brief The first index and the index count of a level, the whole index array without levels.
+    void lodRange(int lod, GLsizei indexSize, GLint &first, GLsizei &count);
+    //! \brief Release the buffers, unless the pool holds them.
+    void freeMesh(GLuint &VAO, GLuint &VBO, GLuint &EBO);
+    /** \brief Find the bounds the positions (and the texture
+     *  coordinates, when texCoord is not negative) are packed in.
+     *  Each vertex is stride floats, texCoord is the float index
+     *  of its texture coordinates.
+     */
+    void packBounds(const float *vertices, int stride, int count, int texCoord = -1);
+    //! \brief Pack a position within the bounds.
+    void packPosition(const float *position, GLushort *packed);
+    //! \brief Pack texture coordinates within their bounds.
+    void packTexCoords(const float *texCoords, GLushort *packed);
+    //! \brief The uniforms that unpack the position and texture coordinates.
+    void setPackedUniforms(Shader *shader);
+    //! True when the vertex buffer holds, or will hold, packed vertices.
+    bool packed = false;
+    //! The packed values map onto offset + value * scale.
+    vec3 positionOffset = vec3(0.0f), positionScale = vec3(1.0f);
+    vec2 uvOffset = vec2(0.0f), uvScale = vec2(1.0f);
+    //! Where the mesh is in the pool, or its own vertex array.
+    MeshRange range;
+    static bool packing;
     
 };
 
@@ -0,0 +1,109 @@
+/**********************************************************
+ *   MeshCache:  A class to keep the meshes of an asset file,
+ *   as assimp and the Model class left them, in a binary
+ *   cache file.  Later starts map the file and upload the
+ *   vertices and indices straight from it, assimp is not run.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "commonheader.h"
+#include "mappedfile.h"
+#include "info.h"
+#include "resourcearchive.h"
+#include "meshsimplifier.h"
+#include <memory>
+
+//! The first bytes of a mesh cache file.
+#define MESH_CACHE_MAGIC "MESHCCH1"
+//! Changed with the layout of the file or of the vertices.
+#define MESH_CACHE_VERSION 2
+
+//! Forward declarations so it can be used as a library.
+struct Vertex;
+struct Vertex1;
+struct Texture;
+
+//! \brief The header of a mesh cache file, the meshes follow it.
+struct MeshCacheHeader {
+    char magic[8];
+    GLuint64 key;
+    GLuint meshes;
+    GLuint version;
+};
+
+/** \brief One mesh in the cache file.  It is followed by its
+ *  texture references (two lengths, the type and the path, padded
+ *  to four bytes), its levels of detail, then the vertices and then
+ *  the indices of every level.
+ */
+struct MeshCacheEntry {
+    GLuint textured;
+    GLuint vertSize;
+    GLuint indexSize;
+    GLuint texCount;
+    GLuint lodCount;
+    float opacity;
+    float color[3];
+};
+
+/** \brief A mesh read from the cache.  The vertices and indices
+ *  point into the mapped file, the textures have no ids yet.
+ */
+struct CachedMesh {
+    bool textured = false;
+    const Vertex *vertices = nullptr;
+    const Vertex1 *plainVertices = nullptr;
+    const GLuint *indices = nullptr;
+    int vertSize = 0;
+    int indexSize = 0;
+    float opacity = 1.0f;
+    vec3 color = vec3(1.0f, 1.0f, 1.0f);
+    vector<Texture> textures;
+    vector<MeshLod> lods;
+};
+
+/** \class MeshCache The cache files are kept in
+ *  ~/.config/assimpopengl/meshcache, one per asset file.  The key
+ *  hashes the asset, the material libraries an .obj names, the
+ *  import flags, the texture maps, the optimizer and level of
+ *  detail versions and the vertex layout, so a change to any of
+ *  them makes a new file and the old one is removed.
+ */
+class MeshCache
+{
+public:
+    /** \brief The key of an asset file loaded with the given import
+     *  flags and texture maps, false if it cannot be read.
+     */
+    static bool contentKey(const string &asset, GLuint flags, GLuint maps, GLuint64 &key);
+    /** \brief Map the cache file of an asset and describe its meshes.
+     *  The mapping must be kept as long as the meshes are used.
+     */
+    static bool load(const string &asset, GLuint64 key, vector<CachedMesh> &meshes,
+    shared_ptr<MappedFile> &mapping);
+    //! \brief Write the meshes of an asset to its cache file.
+    static bool store(const string &asset, GLuint64 key, const vector<MeshInfo> &meshes);
+    /** \brief Describe the meshes of an asset from the mounted
+     *  resource archive, without reading the asset.
+     */
+    static bool loadArchived(const string &asset, vector<CachedMesh> &meshes,
+    shared_ptr<MappedFile> &mapping);
+    //! \brief Turn the cache on or off, it is on unless turned off.
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    //! \brief The cache file of an asset, and the prefix all its versions share.
+    static string cacheFile(const string &asset, GLuint64 key, string &prefix);
+protected:
+    //! \brief Fold a whole file into a hash, false if it cannot be read.
+    static bool hashFile(const string &file, GLuint64 &key, string *contents = nullptr);
+    //! \brief Describe the meshes in a cache file, checking the key unless it is null.
+    static bool readMeshes(const string &file, const ResourceView &view, const GLuint64 *key,
+    vector<CachedMesh> &meshes);
+    static bool enabled;
+};
+
+#endif // MESHCACHE_H
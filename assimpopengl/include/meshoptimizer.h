@@ -0,0 +1,93 @@
+/**********************************************************
+ *   MeshOptimizer:  A class to reorder the vertices and
+ *   triangles of a mesh at load time, so the GPU transforms
+ *   each vertex fewer times, shades fewer hidden pixels and
+ *   reads the vertex buffer in order.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "commonheader.h"
+
+//! Changed with the passes, the cached meshes are made again.
+#define MESH_OPTIMIZER_VERSION 1
+//! The FIFO post transform cache the ACMR is measured with, that of older GPUs.
+#define VERTEX_CACHE_SIZE 16
+//! The LRU cache the triangle order is scored against.
+#define VERTEX_SCORE_CACHE_SIZE 32
+//! How much worse the ACMR may get for a better overdraw order.
+#define OVERDRAW_THRESHOLD 1.05f
+
+/** \brief The figures for one mesh, or totals for many.  ACMR is
+ *  the average number of vertices transformed per triangle, from
+ *  0.5 at best to 3 at worst.
+ */
+struct MeshOptimizeStats {
+    GLuint verticesBefore = 0;
+    GLuint verticesAfter = 0;
+    GLuint triangles = 0;
+    //! The vertex transforms, ACMR times the triangles.
+    GLuint missesBefore = 0;
+    GLuint missesAfter = 0;
+    //! Set when the overdraw order was kept.
+    bool overdraw = false;
+    float acmrBefore() const
+    {
+        return triangles ? (float)missesBefore / triangles : 0.0f;
+    }
+    float acmrAfter() const
+    {
+        return triangles ? (float)missesAfter / triangles : 0.0f;
+    }
+};
+
+/** \class MeshOptimizer The passes, in order:  identical vertices
+ *  are merged, the triangles are ordered for the vertex cache
+ *  (Forsyth's linear speed method), the cache friendly runs of
+ *  triangles are put outward facing first to cut overdraw, and
+ *  the vertices are renumbered in the order they are first used.
+ *  The vertices may be of any layout that starts with the position
+ *  as three floats.  Everything is done in place.
+ */
+class MeshOptimizer
+{
+public:
+    /** \brief Optimize a mesh, returning the new vertex count.  The
+     *  vertices are stride bytes each.  A mesh that is not a list of
+     *  triangles is left as it is.
+     */
+    static GLuint optimize(unsigned char *vertices, size_t stride, GLuint vertexCount,
+    GLuint *indices, GLuint indexCount, MeshOptimizeStats &stats);
+    //! \brief The vertex transforms of an index list through a FIFO cache.
+    static GLuint cacheMisses(const GLuint *indices, GLuint indexCount, GLuint vertexCount,
+    int cacheSize = VERTEX_CACHE_SIZE);
+    //! \brief Add the figures of a mesh to a total.
+    static void addStats(MeshOptimizeStats &total, const MeshOptimizeStats &stats);
+    //! \brief Print the before and after figures.
+    static void printStats(const MeshOptimizeStats &stats, const string &name);
+    //! \brief Turn the passes on or off, they are on unless turned off.
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+protected:
+    //! \brief Merge identical vertices, returning the new vertex count.
+    static GLuint mergeVertices(unsigned char *vertices, size_t stride, GLuint vertexCount,
+    GLuint *indices, GLuint indexCount);
+    //! \brief Order the triangles for the vertex cache.
+    static void orderForCache(GLuint *indices, GLuint indexCount, GLuint vertexCount);
+    /** \brief Order the runs of the cache order outward facing first.
+     *  False if it would cost too much of the cache order.
+     */
+    static bool orderForOverdraw(const unsigned char *vertices, size_t stride, GLuint vertexCount,
+    GLuint *indices, GLuint indexCount);
+    //! \brief Renumber the vertices in the order of first use, returning the count used.
+    static GLuint orderForFetch(unsigned char *vertices, size_t stride, GLuint vertexCount,
+    GLuint *indices, GLuint indexCount);
+    //! \brief The Forsyth score of a vertex.
+    static float vertexScore(int cachePosition, int remaining);
+    static bool enabled;
+};
+
+#endif // MESHOPTIMIZER_H
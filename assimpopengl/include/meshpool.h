@@ -0,0 +1,112 @@
+/**********************************************************
+ *   MeshPool:  A class to hold the vertices and indices of
+ *   many meshes in a few large buffer objects.  Meshes with
+ *   the same vertex layout share one vertex array, and each
+ *   is drawn from its own range of the buffers with a base
+ *   vertex and a first index.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef MESHPOOL_H
+#define MESHPOOL_H
+
+#include "commonheader.h"
+
+//! The bytes of vertices, and of indices, in a new pair of buffers.
+#define MESH_POOL_BLOCK (4 * 1048576)
+
+/** \brief A vertex of MeshTex as it is uploaded when packed, 20
+ *  bytes in place of 44.  The position is unsigned normalized
+ *  within the bounds of the mesh (the fourth value pads it to
+ *  eight bytes), the normal and binormal are octahedral signed
+ *  normalized, and the texture coordinates are unsigned
+ *  normalized within their own bounds.
+ */
+struct PackedVertex {
+    GLushort Position[4];
+    GLshort Normal[2];
+    GLshort BiNormal[2];
+    GLushort TexCoords[2];
+};
+
+//! \brief A vertex of MeshVert as it is uploaded when packed, 16 bytes in place of 36.
+struct PackedVertex1 {
+    GLushort Position[4];
+    GLshort Normal[2];
+    GLshort BiNormal[2];
+};
+
+//! \brief The vertex layouts, the meshes of each share their own buffers.
+enum VertexLayout {
+    //! Vertex, as loaded.
+    LAYOUT_TEXTURED = 0,
+    //! Vertex1, as loaded.
+    LAYOUT_PLAIN = 1,
+    LAYOUT_PACKED_TEXTURED = 2,
+    LAYOUT_PACKED_PLAIN = 3
+};
+
+/** \brief A vertex buffer and an index buffer of one layout,
+ *  and the vertex array that reads them.  Used counts the bytes
+ *  of vertices and the indices handed out so far.
+ */
+struct MeshArena {
+    int layout = LAYOUT_TEXTURED;
+    GLuint vao = 0, vbo = 0, ebo = 0;
+    GLsizeiptr vertexCapacity = 0, vertexUsed = 0;
+    GLsizeiptr indexCapacity = 0, indexUsed = 0;
+    int meshes = 0;
+};
+
+/** \brief Where a mesh was put:  its arena, the vertex array to
+ *  bind, the base vertex and the first index of its draw.
+ */
+struct MeshRange {
+    int arena = -1;
+    GLuint vao = 0;
+    GLint baseVertex = 0;
+    GLint firstIndex = 0;
+};
+
+/** \class MeshPool Suballocates meshes from large buffers, a new
+ *  pair of buffers is started when the last one of a layout is
+ *  full.  Nothing is given back until the pool is deleted, the
+ *  meshes are expected to live as long as the pool.  Without base
+ *  vertex draws (GL 3.2 or ARB_draw_elements_base_vertex) the
+ *  indices are rebased as they are copied in, and the base vertex
+ *  is always zero.
+ */
+class MeshPool
+{
+public:
+    //! \brief Constructor, blockSize is the size of each new buffer.
+    MeshPool(GLsizeiptr blockSize = MESH_POOL_BLOCK);
+    //! \brief Delete the buffers and vertex arrays.
+    ~MeshPool();
+    //! \brief Copy a mesh into the buffers of its layout.
+    MeshRange allocate(int layout, const GLvoid *vertices, GLsizei vertexCount,
+    const GLuint *indices, GLsizei indexCount);
+    /** \brief Another vertex array over the buffers of an arena,
+     *  for draws that add attributes of their own (the instance
+     *  matrices).  The caller deletes it.
+     */
+    GLuint createVertexArray(int arena);
+    //! \brief Point the vertex attributes of a layout at the bound array buffer.
+    static void vertexAttributes(int layout);
+    //! \brief The size of a vertex of a layout.
+    static GLsizei vertexSize(int layout);
+    //! \brief True when the draws can take a base vertex.
+    static bool hasBaseVertex();
+    //! \brief Print the buffers and how full they are.
+    void printStats();
+protected:
+    //! \brief The arena a mesh fits in, starting a new one if need be.
+    int findArena(int layout, GLsizeiptr vertexBytes, GLsizeiptr indexCount);
+    vector<MeshArena> arenas;
+    GLsizeiptr blockSize;
+    //! Debug output.
+    bool debug1 = false;
+};
+
+#endif // MESHPOOL_H
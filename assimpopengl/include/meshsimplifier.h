@@ -0,0 +1,72 @@
+/**********************************************************
+ *   MeshSimplifier:  A class to build coarser levels of
+ *   detail of a mesh at load time, by vertex clustering, so
+ *   the objects far from the camera are drawn with fewer
+ *   triangles.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include "commonheader.h"
+
+//! Changed with the clustering, the cached meshes are made again.
+#define MESH_LOD_VERSION 1
+//! The levels of a mesh at most, the full mesh included.
+#define MESH_LOD_LEVELS 4
+//! The grid cells across the longest side of a mesh for its first coarser level, halved for each level after.
+#define MESH_LOD_DIVISIONS 64
+//! A level is kept only when it has at most this share of the triangles of the level before it.
+#define MESH_LOD_REDUCTION 0.75f
+//! The error a level may show on the screen, in pixels.
+#define LOD_ERROR_PIXELS 2.0f
+
+/** \brief A level of detail of a mesh:  its range of the mesh's
+ *  index array, and its error, the size of the cells its vertices
+ *  were clustered in, in object units.
+ */
+struct MeshLod {
+    GLuint firstIndex = 0;
+    GLuint indexCount = 0;
+    float error = 0.0f;
+};
+
+/** \class MeshSimplifier Each coarser level is clustered from the
+ *  full mesh on a grid twice as coarse as the level before.  The
+ *  vertices of a cell are split by the axis their normal is closest
+ *  to, so the hard edges are kept, and the vertex nearest the middle
+ *  of its cell stands for the others.  No vertices are made, a level
+ *  is only another index list over the vertices of the mesh, so the
+ *  levels share one vertex buffer.  The vertices may be of any layout
+ *  that starts with the position and the normal, three floats each.
+ */
+class MeshSimplifier
+{
+public:
+    /** \brief Build the levels of a mesh.  The indices hold the full
+     *  mesh on the way in and every level, one after the other, on
+     *  the way out.  The levels are described in lods, level 0 (the
+     *  full mesh) first.
+     */
+    static void buildLods(const unsigned char *vertices, size_t stride, GLuint vertexCount,
+    vector<GLuint> &indices, vector<MeshLod> &lods);
+    //! \brief Cluster the triangles of a mesh on a grid of cells of the given size.
+    static void cluster(const unsigned char *vertices, size_t stride, GLuint vertexCount,
+    const GLuint *indices, GLuint indexCount, const float *origin, float cellSize,
+    vector<GLuint> &clustered);
+    /** \brief The coarsest level whose error is within LOD_ERROR_PIXELS,
+     *  pixelsPerUnit being the screen size of one object unit.
+     */
+    static int selectLod(const vector<MeshLod> &lods, float pixelsPerUnit);
+    //! \brief Turn the levels on or off, they are on unless turned off.
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+protected:
+    //! \brief Which of the six axis directions a normal is closest to.
+    static GLuint normalClass(const float *normal);
+    static bool enabled;
+};
+
+#endif // MESHSIMPLIFIER_H
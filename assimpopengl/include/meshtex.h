@@ -32,8 +32,24 @@ public:
     /*  Functions  */
     //! \brief Pass in the data from the Model class to be realized here.
     void setData(Vertex *vertices, GLuint *indices, vector<Texture>textures, int vertSize, int indexSize, int texSize);
-    //! \brief Draw the object.
-    void Draw(Shader *shader, glm::mat4 view, glm::mat4 projection, glm::mat4 model, vector<PointLight> lights, vector<SpotLight>spotLights, vec3 viewPos, int startIndex = 0, bool diffOnly = true);
+    //! \brief Set the per mesh uniforms for a queued draw.
+    void setUniforms(Shader *shader, const glm::mat4 *model, int startIndex = 0);
+    //! \brief Attach the per instance model matrices.
+    void setInstanceBuffer(GLuint buffer, GLintptr offset = 0);
+    //! \brief The shader features of the mesh.
+    GLuint getFeatures(bool diffOnly = true);
+    //! \brief Describe this mesh as a render queue item.
+    void fillItem(RenderItem &item, int startIndex = 0, int lod = 0);
+    /** \brief The textures given units from startIndex on, the
+     *  first ones, up to MAX_ITEM_TEXTURES and QUEUE_TEXTURE_UNITS.
+     *  fillItem() binds them and setUniforms() points the samplers
+     *  at them.
+     */
+    int boundTextures(int startIndex);
+    //! \brief Set a texture object that was uploaded after the mesh was built.
+    void setTextureId(int index, GLuint id);
+    //! \brief The per draw record for a multi draw.
+    void fillDrawData(DrawData &data);
     //! \brief For debugging.
     void dumpData();
     //! \brief Create the mesh data OpenGL buffer object.
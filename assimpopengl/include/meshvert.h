@@ -35,8 +35,16 @@ public:
     /*  Functions  */
     //! \brief Pass data to be displayed here from the Model class.
     void setData(Vertex1 *vertices, GLuint *indices, vec3 color, int vertSize, int indexSize);
-    //! \brief Display the data.
-    void Draw(Shader *shader, glm::mat4 view, glm::mat4 projection, glm::mat4 model, vector<PointLight>lights, vector<SpotLight>spotLights, vec3 viewPos, int  startIndex = 0);
+    //! \brief Set the per mesh uniforms for a queued draw.
+    void setUniforms(Shader *shader, const glm::mat4 *model, int startIndex = 0);
+    //! \brief Attach the per instance model matrices.
+    void setInstanceBuffer(GLuint buffer, GLintptr offset = 0);
+    //! \brief The shader features of the mesh.
+    GLuint getFeatures(bool diffOnly = true);
+    //! \brief Describe this mesh as a render queue item.
+    void fillItem(RenderItem &item, int startIndex = 0, int lod = 0);
+    //! \brief The per draw record for a multi draw.
+    void fillDrawData(DrawData &data);
     //! Class global variables.
     /*  Mesh Data  */
     //! The vertex array.
@@ -52,6 +60,8 @@ public:
     int vertSize, indexSize;
     //! The default color of the object.
     vec3 colordiff = vec3(1.0f, 1.0f, 1.0f);
+    //! Copious debug data.
+    bool debug1 = false;
     /*  Functions    */
     //! \brief Create the vertex array buffer, buffer object and index buffers.
     void setupMesh();
@@ -13,14 +13,61 @@
 #include "meshvert.h"
 #include "meshtex.h"
 #include "createimage.h"
+#include "texturestreamer.h"
 #include "info.h"
 #include "shader.h"
+#include "renderqueue.h"
+#include "ringbuffer.h"
+#include "meshcache.h"
+#include "textureregistry.h"
+#include "meshoptimizer.h"
+#include "meshpool.h"
+#include "meshsimplifier.h"
+
+//! The assimp post processing steps, they are part of the mesh cache key.
+#define MODEL_IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals \
+    | aiProcess_GenUVCoords | aiTextureFlags_UseAlpha | aiProcess_CalcTangentSpace)
 
 //! Forward declarations so it can be used as a library.
 struct PointLight;
 struct Texture;
 struct SpotLight;
 
+/** \brief The objects loaded from one asset file.  The file is
+ *  read once and its meshes are shared by every object that uses
+ *  it.  When there is more than one such object the meshes are
+ *  drawn instanced, with the model matrices streamed through the
+ *  frame's ring buffer.
+ */
+struct InstanceGroup {
+    string path;
+    vector<MeshInfo> meshes;
+    //! Indices into the model description vector, furthest first when transparent.
+    vector<int> members;
+    //! A mesh of the file is not fully opaque, so the instances are drawn back to front.
+    bool transparent = false;
+    //! The per instance model matrices.
+    vector<mat4> matrices;
+    //! The vertex arrays of the instanced draws, by pool arena.
+    map<int, GLuint> arrays;
+};
+
+//! The texture id of a deferred mesh whose image is decoded but not yet uploaded.
+#define MODEL_PENDING_TEXTURE 0xFFFFFFFFu
+
+//! The texture maps loaded unless the caller asks for fewer.
+#define MODEL_ALL_MAPS (FEATURE_DIFFUSE_MAP | FEATURE_SPECULAR_MAP | FEATURE_NORMAL_MAP)
+
+/** \brief A texture slot of a material that the shaders can
+ *  sample, the name it is bound under and the feature that
+ *  samples it.
+ */
+struct MaterialSlot {
+    aiTextureType type;
+    const char *name;
+    GLuint feature;
+};
+
 /** \class Model A class to extract 3D asset data from a 
  * resource file and pass it along to the mesh files for 
  * display.
@@ -30,53 +77,151 @@ class Model
 public:
     /*  Functions   */
     /** \brief Pass a vector containing file names of asset files 
-     * and their associated positions and orientations.
+     * and their associated positions and orientations.  With a
+     * streamer the textures arrive over the first frames.  Only
+     * the texture maps in maps (a mask of ShaderFeature values,
+     * see ShaderSet::sampledMaps()) are loaded.  The meshes are
+     * put in the pool given, so models can share one, or in a pool
+     * of the model's own.  A deferred model only reads the files
+     * and decodes the images, touching no GL, so it can be built on
+     * a loading thread; finishLoading() then uploads it on the
+     * thread with the context.
      */
-    Model(vector<ModelInfo> modelinfo);
+    Model(vector<ModelInfo> modelinfo, TextureStreamer *streamer = nullptr, GLuint maps = MODEL_ALL_MAPS,
+    MeshPool *pool = nullptr, bool deferred = false);
     //! \brief Destructor, signals destruction of the class.
     ~Model();
     /** \brief Draw the assets that were obtained.  Pass along
      *  the positions of the point lights and spotlights as well as 
      *  the position and orientation of each object being displayed.
      */
-    void Draw(Shader *shader, glm::mat4 view, glm::mat4 projection, vector<ModelInfo>model, vector<PointLight>lights, vector<SpotLight>spotLights, vec3 viewPos, int startIndex = 0, bool diffOnly = true);   
+    void Draw(Shader *shader, const glm::mat4 &view, const glm::mat4 &projection, const vector<ModelInfo> &model, const vector<PointLight> &lights, const vector<SpotLight> &spotLights, const vec3 &viewPos, int startIndex = 0, bool diffOnly = true);   
+    /** \brief Add a render queue item for every mesh of every object.
+     *  The frame block (view, projection, camera position and lights)
+     *  is left to the caller, who writes it once a frame.  The instance
+     *  matrices are written into the ring, between the caller's
+     *  beginFrame() and flush().  Every mesh binds its textures from
+     *  startIndex up.
+     */
+    void enqueue(RenderQueue *queue, RingBuffer *ring, Shader *shader, const vector<ModelInfo> &model, const vec3 &viewPos, int startIndex = 0, bool diffOnly = true);
+    /** \brief Choose the shader variant of every mesh from its
+     *  material, starting the compile of each variant needed.
+     *  Called once the model is built, a deferred model before its
+     *  uploads so the compiles overlap them, enqueue() then uses the variant
+     *  in place of the shader it is given.  The features are added
+     *  to every variant, such as FEATURE_CLUSTERED_LIGHTS.
+     */
+    void selectPrograms(ShaderSet *shaders, bool diffOnly = true, GLuint features = 0);
+    /** \brief Draw the meshes from per draw data, so the render
+     *  queue can join them into multi draws.  Set before
+     *  selectPrograms(), as it picks the DRAW_DATA variants.
+     */
+    void setMultiDraw(bool multiDraw);
+    /** \brief Upload the textures and meshes of a deferred model,
+     *  for up to budgetMs milliseconds (no limit when it is not
+     *  positive).  Returns true once everything is uploaded, call it
+     *  once a frame until then.
+     */
+    bool finishLoading(double budgetMs = 0.0);
+    //! \brief The fraction of the meshes uploaded, for a progress display.
+    float uploadProgress();
+    //! \brief True when the model can be drawn.
+    bool isLoaded();
+    /** \brief Draw the meshes at the level of detail their screen
+     *  size calls for, from the projection and the viewport height
+     *  in pixels.  Call it when either changes, until then every
+     *  mesh is drawn in full.
+     */
+    void setLodProjection(const glm::mat4 &projection, int viewportHeight);
     //! \brief Accessor function to let the calling class know whether there are textures or not.
     bool hasTextures();
 private:
     /*  Functions   */
     //! \brief Open the asset for extraction.
     void loadModel(string path);
+    /** \brief Build the meshes of an asset from its mesh cache file
+     *  or its entry in the resource archive, decoding their textures.
+     */
+    void buildCached(const string &path, vector<CachedMesh> &cached, shared_ptr<MappedFile> mapping);
+    //! \brief Decode the images of all the materials on the worker threads.
+    void decodeTextures(const aiScene* scene);
     //! \brief Process a node and all its subnodes, extracting meshes and textures.
     void processNode(aiNode* node, const aiScene* scene);
     //! \brief Extract a textutre.
     MeshInfo processMesh(aiMesh* mesh, const aiScene* scene);
-    //! \brief Compare distances
-    static bool cmpdist(const ModelInfo &a, const ModelInfo &b);
-    /** \brief Sort the objects by their distance from the
-     *  camera.  Furthest first, closest last.
+    /** \brief Run the mesh optimizer over a mesh's vertices and the
+     *  index array, returning the new vertex count.
+     */
+    int optimizeMesh(unsigned char *vertices, size_t stride, int vertSize);
+    /** \brief Build the levels of detail of a mesh, the index array
+     *  is replaced by one holding every level.
+     */
+    void buildLods(const unsigned char *vertices, size_t stride, int vertSize);
+    //! \brief The largest scale along the axes of a model matrix.
+    static float matrixScale(const glm::mat4 &model);
+    /** \brief Copy the transforms that changed since the last
+     *  frame into the persistent model description vector.
      */
-    void sortDists(vec3 viewPos);
-    /** \breif Sort the objects by idval.  We use this to reassign
-     *  the meshes to each object when we call the draw function.
+    void updateTransforms(const vector<ModelInfo> &model);
+    /** \brief Find the distances from the camera and sort the
+     *  transparent objects, at the end of the draw order, furthest
+     *  first, and the members of the transparent instance groups
+     *  the same way.  The opaque objects need no order among
+     *  themselves.  An insertion sort is used on the persistent
+     *  orders, as they rarely change between frames it is close
+     *  to linear and never allocates.
      */
-    //! \brief Compares ID values for sorting.
-    static bool cmpid(const ModelInfo &a, const ModelInfo &b);
-    /** \brief Sort the objects by their ID values.
+    void sortDists(const vec3 &viewPos);
+    //! \brief True when an object has a mesh that is not fully opaque.
+    bool isTransparent(int object);
+    /** \brief Get the textures of a material in one pass over the
+     *  slots the shaders sample, the others are not looked at.
      */
-    void sortIDs();
-    //! \brief Get the texture from the assimp material file.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+    void materialTextures(aiMaterial* mat, vector<Texture> &textures);
+    //! \brief Get the textures of one slot from the assimp material file.
+    void loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, vector<Texture> &textures);
     /** \brief Get the image data from the graphic file
-     *  using Free Image Plus.
+     *  using Free Image Plus.  The texture is shared through the
+     *  registry with every other mesh and model using the image.
      */
     GLint TextureFromFile(string filename);
-    //! The model description vector.
+    //! The model description vector, kept in the order it was passed in.
     vector<ModelInfo>modelinfo;
+    //! Indices into modelinfo in drawing order, the opaque objects before the transparent ones.
+    vector<int> drawOrder;
+    //! Where the transparent objects start in the draw order.
+    int firstTransparent = 0;
+    //! The asset files and the objects using each of them.
+    vector<InstanceGroup> groups;
+    //! The group of each object in modelinfo.
+    vector<int> groupOf;
+    //! The queue and the frame data ring used by Draw.
+    RenderQueue drawQueue;
+    RingBuffer *frameRing = nullptr;
     //! A vector of Mesh classes, can be both MeshTex and MeshVert because
     //! they are both implementations of Mesh.
     vector<MeshInfo> meshes;
-    //! A vector of Textures acquired for the MeshTex class.
-    vector<Texture> textures_loaded;
+    //! The mapped mesh cache files, the cached meshes point into them.
+    vector<shared_ptr<MappedFile>> meshMappings;
+    //! The decoded images of the file being loaded, by path.
+    map<string, DecodedImage> decoded;
+    //! The pixel buffer uploader for the textures, if any.
+    TextureStreamer *streamer = nullptr;
+    //! The buffers the meshes are drawn from, and whether this model made them.
+    MeshPool *pool = nullptr;
+    bool ownPool = false;
+    //! Deferred loading, the next mesh to upload and the meshes uploaded.
+    bool deferred = false;
+    bool loaded = false;
+    int uploadGroup = 0, uploadMesh = 0, uploaded = 0, meshTotal = 0;
+    //! The levels of detail of the mesh being built.
+    vector<MeshLod> lods;
+    //! The pixels one unit covers at a distance of one unit, zero draws every mesh in full.
+    float lodScale = 0.0f;
+    //! The meshes are drawn from per draw data.
+    bool multiDraw = false;
+    //! The texture maps loaded, a mask of ShaderFeature values.
+    GLuint maps = MODEL_ALL_MAPS;
     //! The textures vector, one for each textured mesh.
     vector<Texture>textures;
     //! \breif The index array.
@@ -89,6 +234,8 @@ private:
     string directory, filename;
     //! Book keeping variables.
     GLuint texcount = 0, vertcount = 0, count1 = 0, limit = 0;
+    //! The optimizer figures for the file being loaded.
+    MeshOptimizeStats optimizeTotals;
     //! The alpha value for the shader.
     float opacity;
     //! Copious debug value to be had.
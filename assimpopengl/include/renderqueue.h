@@ -0,0 +1,227 @@
+/**********************************************************
+ *   RenderQueue:  A class to collect the draw calls for a
+ *   frame, sort them by pass, program, textures, vertex
+ *   array and depth, and submit them without repeating
+ *   state changes that are already in place.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "commonheader.h"
+#include "shader.h"
+
+//! The most textures a single draw item binds.
+#define MAX_ITEM_TEXTURES 4
+/** The texture units the items may bind, the ones from here up are
+ *  kept for textures bound once a frame (the light clusters).
+ */
+#define QUEUE_TEXTURE_UNITS 12
+//! The number of texture units whose bindings are tracked.
+#define MAX_TRACKED_UNITS 16
+//! The attribute location of the per draw data, after the vertex attributes.
+#define DRAW_DATA_LOCATION 4
+//! The vec4 attributes of a DrawData record.
+#define DRAW_DATA_ATTRIBUTES 8
+
+//! Forward declarations so it can be used as a library.
+class Mesh;
+
+/** \brief The passes are drawn in this order.  Within the
+ *  opaque pass items are grouped by state and drawn front
+ *  to back, the transparent pass is drawn back to front.
+ *  The sky comes after the opaque pass, at the far plane with
+ *  GL_LEQUAL, so it is only shaded where nothing covers it.
+ */
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_SKY = 1,
+    PASS_TRANSPARENT = 2
+};
+
+/** \brief The data of one draw (or one instance) of a multi
+ *  draw, read as instanced vertex attributes at DRAW_DATA_LOCATION
+ *  on, the record picked by the base instance of the draw.  It
+ *  stands in for the per mesh uniforms under DRAW_DATA in the
+ *  shader.
+ */
+struct DrawData {
+    mat4 model;
+    //! The color in xyz and the opacity in w.
+    vec4 color;
+    //! The packed position offset in xyz and the shininess in w.
+    vec4 positionOffset;
+    vec4 positionScale;
+    //! The packed texture coordinate offset in xy and scale in zw.
+    vec4 uvTransform;
+};
+
+//! \brief A command of glMultiDrawElementsIndirect, in the layout GL reads.
+struct DrawElementsCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/** \brief Consecutive items of the sorted order drawn as one
+ *  multi draw, with their commands in the indirect buffer.
+ */
+struct MultiDrawRun {
+    int first = 0;
+    int items = 0;
+    int command = 0;
+    int commands = 0;
+};
+
+//! \brief A texture to bind to a given texture unit.
+struct TextureBinding {
+    GLenum target;
+    GLuint id;
+    GLint unit;
+};
+
+/** \brief One draw call and the state it needs.  If a mesh
+ *  is given it sets its own per object uniforms, otherwise
+ *  only the model matrix (if any) is passed to the shader.
+ *  Instanced items take their model matrices from the
+ *  instance buffer of the vertex array.
+ */
+struct RenderItem {
+    int pass = PASS_OPAQUE;
+    Shader *shader = nullptr;
+    GLuint vao = 0;
+    TextureBinding textures[MAX_ITEM_TEXTURES];
+    int texCount = 0;
+    //! Distance from the camera.
+    float depth = 0.0f;
+    Mesh *mesh = nullptr;
+    const mat4 *model = nullptr;
+    int startIndex = 0;
+    bool diffOnly = true;
+    //! Draw parameters, glDrawElements when indexed, else glDrawArrays.
+    GLenum mode = GL_TRIANGLES;
+    GLint first = 0;
+    GLsizei count = 0;
+    bool indexed = false;
+    //! Added to each index, for meshes sharing the buffers of a MeshPool.
+    GLint baseVertex = 0;
+    /** True when the shader reads the per draw data (its DRAW_DATA
+     *  variant), so the item can join a multi draw.  The model matrix
+     *  comes from model, or from matrices for each of the instances.
+     */
+    bool multiDraw = false;
+    const mat4 *matrices = nullptr;
+    //! The number of instances, zero for an ordinary draw.
+    GLsizei instances = 0;
+    //! The sort key, calculated when the item is added.
+    GLuint64 key = 0;
+};
+
+/** \brief Counters for one frame.  The avoided counts are
+ *  the binds that were skipped because the state was
+ *  already in place.
+ */
+struct RenderStats {
+    int items = 0;
+    int drawCalls = 0;
+    int programBinds = 0;
+    int programBindsAvoided = 0;
+    int textureBinds = 0;
+    int textureBindsAvoided = 0;
+    int vaoBinds = 0;
+    int vaoBindsAvoided = 0;
+    //! The draws made through the per draw data, and the multi draw calls among the draw calls.
+    int dataDraws = 0;
+    int multiDrawCalls = 0;
+    //! The triangles drawn, every instance counted.
+    GLuint64 triangles = 0;
+    //! Samples passed in the sky pass, when measured.
+    bool skyMeasured = false;
+    GLuint skySamples = 0;
+};
+
+/** \class RenderQueue Collects the draw items for a frame and
+ *  submits them in sort key order, then the transparent items
+ *  furthest first.  Those are best added back to front, as Model
+ *  does, so their sort has next to nothing to move.  The item
+ *  storage is kept between frames so a steady scene does not
+ *  allocate.
+ */
+class RenderQueue
+{
+public:
+    //! \brief Constructor, depthRange is the far plane used to scale depth.
+    RenderQueue(float depthRange = 10000.0f);
+    ~RenderQueue();
+    //! \brief Empty the queue for a new frame, keeping the storage.
+    void clear();
+    //! \brief Add an item, its sort key is calculated here.
+    void add(const RenderItem &item);
+    //! \brief Sort the items and draw them.
+    void submit();
+    //! \brief The counters of the last submit.
+    const RenderStats &getStats();
+    //! \brief Print the counters of the last submit.
+    void printStats();
+    /** \brief Count the samples that pass in the sky pass of the
+     *  next submit, with an occlusion query.
+     */
+    void measureSkyOnce();
+    //! \brief Draw the sky before the opaque pass, for comparison.
+    void setSkyFirst(bool skyFirst);
+    bool getSkyFirst();
+    /** \brief The way items with per draw data are drawn:  one
+     *  glMultiDrawElementsIndirect per run (GL 4.3), a loop with a
+     *  base instance (GL 4.2), or a loop pointing the attributes at
+     *  each record.
+     */
+    static bool hasMultiDraw();
+    static bool hasBaseInstance();
+protected:
+    //! \brief Build the 64 bit sort key for an item.
+    GLuint64 makeKey(const RenderItem &item);
+    //! \brief Forget the tracked state, GL may have been changed elsewhere.
+    void resetState();
+    //! \brief Bind the program, textures and vertex array of an item, if they are not bound.
+    void bindState(const RenderItem &item);
+    //! \brief Gather the runs of items with per draw data and upload their records and commands.
+    void buildRuns();
+    //! \brief Draw a run from the per draw data.
+    void drawRun(const MultiDrawRun &run);
+    //! \brief Point the per draw attributes of the bound vertex array at a record.
+    void drawDataAttributes(GLintptr offset);
+    //! \brief True when two items can be drawn in one multi draw.
+    bool sameState(const RenderItem &a, const RenderItem &b);
+    //! \brief Set the depth state of a pass, and start or end the query.
+    void beginPass(int pass);
+    void endPass(int pass);
+    //! The items and the order to draw them in.
+    vector<RenderItem> items;
+    vector<int> order;
+    //! The transparent items, in the order they were added, sorted apart from the keys.
+    vector<int> transparent;
+    //! The state as the queue left it.
+    GLuint boundProgram, boundVAO;
+    GLuint boundTextures[MAX_TRACKED_UNITS];
+    GLenum boundTargets[MAX_TRACKED_UNITS];
+    //! The far plane for depth quantization.
+    float depthRange;
+    RenderStats stats;
+    //! Sky ordering and the sample query.
+    bool skyFirst = false;
+    bool measure = false;
+    GLuint sampleQuery = 0;
+    //! The per draw records, the indirect commands and the runs of the frame.
+    vector<DrawData> drawData;
+    vector<DrawElementsCommand> commands;
+    vector<MultiDrawRun> runs;
+    GLuint dataBuffer = 0, commandBuffer = 0;
+    //! Debug output.
+    bool debug1 = false;
+};
+
+#endif // RENDERQUEUE_H
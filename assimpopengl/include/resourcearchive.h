@@ -0,0 +1,106 @@
+/**********************************************************
+ *   ResourceArchive:  A class to read the resources of the
+ *   program out of one indexed archive file.  The archive is
+ *   mapped once and every resource is a view into it, so the
+ *   program starts from one sequential read rather than a
+ *   file open and a decode for each resource.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef RESOURCEARCHIVE_H
+#define RESOURCEARCHIVE_H
+
+#include "commonheader.h"
+#include "mappedfile.h"
+#include <map>
+#include <memory>
+
+//! The first bytes of a resource archive.
+#define RESOURCE_ARCHIVE_MAGIC "RESARCH1"
+//! Changed with the layout of the archive.
+#define RESOURCE_ARCHIVE_VERSION 1
+//! The alignment of each resource in the archive.
+#define RESOURCE_ALIGNMENT 16
+
+/** \brief What a resource holds.  Raw resources are the source
+ *  file as it is, textures are a texture cache file (the decoded
+ *  mip chain) and meshes are a mesh cache file.
+ */
+enum ResourceKind {
+    RESOURCE_RAW = 0,
+    RESOURCE_TEXTURE = 1,
+    RESOURCE_MESH = 2
+};
+
+//! \brief The header of an archive, the index is at the end of the file.
+struct ResourceArchiveHeader {
+    char magic[8];
+    GLuint version;
+    GLuint entries;
+    GLuint64 indexOffset;
+};
+
+/** \brief An entry of the index.  The names follow the entries,
+ *  each is the path the program would have opened.
+ */
+struct ResourceEntry {
+    GLuint64 offset;
+    GLuint64 size;
+    GLuint64 nameOffset;
+    GLuint nameLength;
+    GLuint kind;
+};
+
+/** \brief A resource in the mapped archive.  The mapping is shared
+ *  so the view stays good after the archive is closed.
+ */
+struct ResourceView {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+    shared_ptr<MappedFile> mapping;
+};
+
+//! \brief A file for the packer to put in an archive.
+struct ResourcePackItem {
+    string name;
+    GLuint kind = RESOURCE_RAW;
+    //! The file the contents are read from.
+    string source;
+};
+
+/** \class ResourceArchive Maps an archive made by resourcepacker
+ *  and finds resources in it by name.  One archive may be mounted,
+ *  the shader, image and mesh loaders look in it before going to
+ *  the file system.  Finding is safe from the decode threads.
+ */
+class ResourceArchive
+{
+public:
+    ResourceArchive();
+    ~ResourceArchive();
+    //! \brief Map an archive and read its index, false if it is not one.
+    bool open(const string &file);
+    void close();
+    bool isOpen();
+    //! \brief The view of a resource of the given kind, false if it is not in the archive.
+    bool find(const string &name, GLuint kind, ResourceView &view) const;
+    //! \brief The number of resources in the archive.
+    int entryCount();
+    //! \brief Write an archive of the given files, through a temporary file.
+    static bool write(const string &file, const vector<ResourcePackItem> &items);
+    //! \brief Make an archive the one the loaders look in, or none with nullptr.
+    static void mount(ResourceArchive *archive);
+    static ResourceArchive *mounted();
+    //! \brief Find a resource in the mounted archive, if there is one.
+    static bool findMounted(const string &name, GLuint kind, ResourceView &view);
+protected:
+    shared_ptr<MappedFile> mapping;
+    //! The entries by name.
+    map<string, ResourceEntry> index;
+    static ResourceArchive *current;
+    //! Debug output.
+    bool debug1 = false;
+};
+
+#endif // RESOURCEARCHIVE_H
@@ -0,0 +1,135 @@
+/**********************************************************
+ *   RingBuffer:  A class to stream the per frame data (the
+ *   camera, the lights and the instance matrices) to the GPU
+ *   through one buffer object that is written once a frame.
+ *   The buffer is split into regions used in turn, and a
+ *   fence keeps a region from being overwritten while the
+ *   GPU may still read it.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include "commonheader.h"
+#include "shader.h"
+
+//! The number of frames that may be in flight.
+#define RING_REGIONS 3
+//! The size of each region in bytes.
+#define RING_REGION_SIZE 65536
+//! The uniform block binding point of the frame data.
+#define FRAME_BLOCK_BINDING 0
+//! The light array sizes of the frame block, as in the shaders.
+#define FRAME_POINT_LIGHTS 6
+#define FRAME_SPOT_LIGHTS 3
+
+//! Forward declarations so it can be used as a library.
+struct PointLight;
+struct SpotLight;
+
+/** \brief A point light in the std140 layout of the shader
+ *  block.  A vec3 takes 16 bytes unless a float follows it,
+ *  so the floats fill the gaps.
+ */
+struct PointLightBlock {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float range;
+};
+
+/** \brief A spot light in the std140 layout of the shader block,
+ *  the range starts a fifth vec4 and the struct is padded out to it.
+ */
+struct SpotLightBlock {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+    float range;
+    float pad[3];
+};
+
+/** \brief The "FrameData" uniform block shared by the shaders,
+ *  it must match the block declared in them.
+ */
+struct FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float pad;
+    PointLightBlock pointLights[FRAME_POINT_LIGHTS];
+    SpotLightBlock spotLights[FRAME_SPOT_LIGHTS];
+};
+
+/** \class RingBuffer A triple buffered stream buffer.  Where
+ *  ARB_buffer_storage is available the buffer is mapped once,
+ *  persistently, and written in place.  Otherwise the frame is
+ *  gathered in client memory and sent with one glBufferSubData.
+ *  Each frame:  beginFrame(), write() the data, flush() before
+ *  the draw calls and endFrame() after them.
+ */
+class RingBuffer
+{
+public:
+    //! \brief Create the buffer, regions of regionSize bytes each.
+    RingBuffer(GLsizeiptr regionSize = RING_REGION_SIZE, int regions = RING_REGIONS);
+    //! \brief Unmap and delete the buffer and the fences.
+    ~RingBuffer();
+    //! \brief Wait until the GPU is done with the next region and start on it.
+    void beginFrame();
+    /** \brief Copy data into the current region.  Returns the
+     *  offset in the buffer, or -1 if the region is full.
+     */
+    GLintptr write(const void *data, GLsizeiptr size, GLsizeiptr alignment = 16);
+    //! \brief Write with the alignment a uniform buffer range needs.
+    GLintptr writeUniform(const void *data, GLsizeiptr size);
+    //! \brief Make the written data visible to the GPU.
+    void flush();
+    //! \brief Fence the region after the frame's draw calls, and move on.
+    void endFrame();
+    //! \brief The buffer object.
+    GLuint getBuffer();
+    //! \brief True when the buffer is persistently mapped.
+    bool isPersistent();
+    /** \brief Fill in the frame block from the camera and the
+     *  light definitions.  Lights past the block sizes are dropped,
+     *  the slots past the lights given are zeroed.
+     */
+    static void fillFrameData(FrameData &frame, const mat4 &view, const mat4 &projection,
+    const vec3 &viewPos, const vector<PointLight> &lights, const vector<SpotLight> &spotLights);
+    //! \brief Copy a light definition into its block layout.
+    static void fillPointLight(PointLightBlock &block, const PointLight &light);
+    static void fillSpotLight(SpotLightBlock &block, const SpotLight &light);
+protected:
+    //! The buffer object and the mapped pointer, if any.
+    GLuint buffer = 0;
+    unsigned char *mapped = nullptr;
+    //! Client side copy of the buffer when it cannot be mapped.
+    vector<unsigned char> staging;
+    //! The fence of each region.
+    vector<GLsync> fences;
+    GLsizeiptr regionSize;
+    int regions;
+    //! The region being written and the bytes used in it.
+    int current = 0;
+    GLsizeiptr used = 0;
+    GLint uniformAlign = 256;
+    bool persistent = false;
+    //! Debug output.
+    bool debug1 = false;
+};
+
+#endif // RINGBUFFER_H
@@ -19,11 +19,35 @@
 
 using namespace std;
 using namespace glm;
+
+//! Forward declarations so it can be used as a library.
+struct PointLight;
+struct SpotLight;
+
+//! The first bytes of a cached program binary.
+#define SHADER_CACHE_MAGIC "SHDRBIN1"
+//! The 64 bit FNV-1a constants.
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/** \brief The header in front of a cached program binary.  The
+ *  key is checked again on load, so a renamed or damaged file is
+ *  never passed to the driver.
+ */
+struct ShaderCacheHeader {
+    char magic[8];
+    GLuint64 key;
+    GLuint format;
+    GLuint length;
+};
+
 /** \class Shader A class to encapsulate the uploading, compiling, 
  * linking and use of a shader.  Note this class requires a seperate 
  * "shaders" directory to store the shaders in.  Further, this class 
- * will create a shader binary and reload it.  The binary will be 
- * recreated if it ceases to validate as a shader program.
+ * will create a shader binary and reload it.  The binary is stored 
+ * under a hash of the shader sources, the GL vendor, renderer and 
+ * version and the binary formats, so any change in those compiles 
+ * the shader again.
  */
 
 class Shader
@@ -37,30 +61,61 @@ public:
      */  
     ~Shader();
     /** \brief Read and build the shader program from two files,
-     *  and provide the file name for the created binary.
+     *  and provide the file name for the created binary.  The name
+     *  is the prefix of the file in ~/.config/assimpopengl/shadercache.
      *  Delete the two shader objects afterwards.
      */
     void initShader(string vertexPath, string fragmentPath, 
-    string outputFile);
+    string outputFile, const string &defines = "");
+    /** \brief Start building the program without waiting on the
+     *  compiler.  With KHR_parallel_shader_compile several programs
+     *  compile at once, and the caller can get on with other work.
+     *  The defines are put after the version line of both sources.
+     */
+    void beginShader(string vertexPath, string fragmentPath, 
+    string outputFile, const string &defines = "");
+    /** \brief Wait for the program started by beginShader(), check
+     *  it and save its binary.  Use() calls this, so the wait falls
+     *  on the first use of the program.
+     */
+    void finishShader();
+    //! \brief True when finishShader() would not have to wait.
+    bool isReady();
     /** \brief Create the vertex or fragment shader from a file.
      */
     unsigned int createShader(unsigned int type, string fpath);
     /** \brief Use the program object for display.
      */
     void Use();
-    /** \brief Create the shader program binary save it to a file,
-     * and delete the binary pointer afterward.
+    /** \brief Save the program binary to the cache file, through
+     *  a temporary file that is renamed into place.
      */
     bool createBinary();
+    //! \brief Fold bytes into a 64 bit FNV-1a hash, the cache keys are made with it.
+    static GLuint64 hashBytes(const void *data, size_t size, GLuint64 hash);
     /** \brief Utility uniform functions that set values in the shader(s).
+     *  The character pointer versions avoid building a string
+     *  for every uniform set in the draw loop.
      */
-    void setBool(const string name, bool value) const;  
-    void setInt(const string name, int value) const;   
-    void setFloat(const string name, float value) const;
-    void setVec2(const std::string name, vec2 value) const;
-    void setVec3(const std::string name, vec3 value) const;
-    void setVec4(const string name, vec4 value) const; 
-    void setMat4(const string name, mat4 value) const;    
+    void setBool(const string &name, bool value) const;  
+    void setInt(const string &name, int value) const;   
+    void setFloat(const string &name, float value) const;
+    void setVec2(const string &name, const vec2 &value) const;
+    void setVec3(const string &name, const vec3 &value) const;
+    void setVec4(const string &name, const vec4 &value) const; 
+    void setMat4(const string &name, const mat4 &value) const;    
+    void setBool(const GLchar *name, bool value) const;  
+    void setInt(const GLchar *name, int value) const;   
+    void setFloat(const GLchar *name, float value) const;
+    void setVec2(const GLchar *name, const vec2 &value) const;
+    void setVec3(const GLchar *name, const vec3 &value) const;
+    void setVec4(const GLchar *name, const vec4 &value) const; 
+    void setMat4(const GLchar *name, const mat4 &value) const;    
+    /** \brief Attach a uniform block of the program to a binding
+     *  point.  The shaders are GLSL ES 3.00, which has no binding
+     *  layout qualifier, so this is done after linking.
+     */
+    void bindBlock(const GLchar *name, GLuint binding);
     //! The shader program object.
     GLuint Program;
     //! Class global variables.
@@ -69,17 +124,32 @@ public:
     GLuint vertex, fragment;
     int progLength = 0;
     int progLenRet = 0;
-    //! Formats for the stored binary program.
-    GLenum *valFormats;
+    //! Format of the stored binary program.
     GLenum format;
-    int response = 0;
-    //! The binary program pointer.
-    unsigned char *binary;
     /**! The output file name.  The final stored binary is stored
-     * int the .config directory of the user's home directory.
+     * in the .config directory of the user's home directory.
      */
     string outputFile;
-
+protected:
+    //! \brief Load the cached binary, false if there is none or it is refused.
+    bool loadBinary();
+    //! \brief Issue the compiles and the link of both shaders.
+    void startCompile();
+    //! \brief Check a compiled shader, printing its log.
+    bool checkShader(unsigned int shaderobj, const string &fpath);
+    //! \brief Read a whole file with one read, or take it from the resource archive.
+    bool readFile(const string &fpath, string &contents);
+    //! \brief Put the defines after the #version line.
+    void insertDefines(string &source, const string &defines);
+    //! The cache key, directory and the file name prefix of this shader.
+    GLuint64 cacheKey = 0;
+    string cacheDir, cachePrefix;
+    bool canCache = false;
+    //! The sources, kept until the program is finished.
+    string vertexPath, fragmentPath, vertexCode, fragmentCode;
+    //! A program was started and not yet finished, and whether from a binary.
+    bool pending = false;
+    bool fromBinary = false;
 };
   
 #endif //SHADER_H
@@ -0,0 +1,59 @@
+/*******************************************************************
+ * ShaderSet:  A class to hold the compiled variants of one pair of
+ *  shader files, one for each combination of material features
+ *  actually used.
+ * Edward C. Eberle <eberdeed@eberdeed.net>
+ * March 2020 San Diego, California USA
+ * ****************************************************************/
+
+#ifndef SHADERSET_H
+#define SHADERSET_H
+
+#include "commonheader.h"
+#include "shader.h"
+#include <map>
+
+/** \brief The material features, each one a #define in the
+ *  shader.  A variant is compiled for every mask in use.
+ */
+enum ShaderFeature {
+    FEATURE_DIFFUSE_MAP = 1,
+    FEATURE_SPECULAR_MAP = 2,
+    FEATURE_NORMAL_MAP = 4,
+    FEATURE_DIFF_ONLY = 8,
+    //! The vertices are in the packed layout of PackedVertex.
+    FEATURE_PACKED_VERTICES = 16,
+    //! The mesh uniforms come from the per draw data of a multi draw.
+    FEATURE_DRAW_DATA = 32,
+    //! The lights come from the cluster lists of LightClusters.
+    FEATURE_CLUSTERED_LIGHTS = 64
+};
+
+/** \class ShaderSet The variants of a shader, by feature mask.
+ *  A variant is started on its first request and compiles while
+ *  the caller goes on, see Shader::beginShader().  Each variant
+ *  caches its own binary.
+ */
+class ShaderSet
+{
+public:
+    //! \brief The shader files and the name the binaries are stored under.
+    ShaderSet(string vertexPath, string fragmentPath, string name);
+    //! \brief Delete the variants.
+    ~ShaderSet();
+    //! \brief The variant for a feature mask, started if it is new.
+    Shader *getVariant(GLuint features);
+    //! \brief All the variants started so far.
+    vector<Shader*> getShaders();
+    //! \brief The #define lines for a feature mask.
+    static string defines(GLuint features);
+    /** \brief The texture maps the shader samples.  With DIFF_ONLY
+     *  the specular term is dropped, so its map is never read.
+     */
+    static GLuint sampledMaps(bool diffOnly);
+protected:
+    string vertexPath, fragmentPath, name;
+    map<GLuint, Shader*> variants;
+};
+
+#endif // SHADERSET_H
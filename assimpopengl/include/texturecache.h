@@ -0,0 +1,75 @@
+/**********************************************************
+ *   TextureCache:  A class to keep each decoded image with
+ *   its whole mip chain in a cache file, keyed by a hash of
+ *   the source image.  On a warm start the cache file is
+ *   mapped and uploaded as it is, with no image decoding.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include "commonheader.h"
+#include "createimage.h"
+#include "resourcearchive.h"
+
+//! The first bytes of a texture cache file.
+#define TEXTURE_CACHE_MAGIC "TEXCACH1"
+//! Changed when the layout or the mip filter changes, so old files are not used.
+#define TEXTURE_CACHE_VERSION 1
+
+/** \brief The header of a texture cache file.  The levels follow
+ *  it, level 0 first, tightly packed four bytes a pixel in the
+ *  given format.
+ */
+struct TextureCacheHeader {
+    char magic[8];
+    GLuint64 key;
+    GLuint width;
+    GLuint height;
+    GLuint levels;
+    GLuint format;
+};
+
+/** \class TextureCache The cache files are kept in
+ *  ~/.config/assimpopengl/texturecache, one per source image,
+ *  named after it and the key.  When the source changes its key
+ *  changes, and the old file is removed when the new one is made.
+ *  Everything here is safe to call from the decode threads.
+ */
+class TextureCache
+{
+public:
+    /** \brief The key of an image, a hash of the contents of the
+     *  file.  False if the file cannot be read.
+     */
+    static bool contentKey(const string &imagefile, GLuint64 &key);
+    /** \brief Map the cache file of an image and point its levels
+     *  into it.  False when there is no good file for this key.
+     */
+    static bool load(const string &imagefile, GLuint64 key, DecodedImage &image);
+    /** \brief Build the mip chain of a decoded image and write it
+     *  to the cache, then map it back in place of the pixels.
+     */
+    static bool store(const string &imagefile, GLuint64 key, DecodedImage &image);
+    /** \brief Point the levels of an image into the mounted resource
+     *  archive.  The archive is taken as it is, the source image is
+     *  not read, so this works where the source is not installed.
+     */
+    static bool loadArchived(const string &imagefile, DecodedImage &image);
+    //! \brief Turn the cache on or off, it is on unless turned off.
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    //! \brief The cache file of an image, and the prefix all its versions share.
+    static string cacheFile(const string &imagefile, GLuint64 key, string &prefix);
+protected:
+    /** \brief Point the levels of an image into a mapped cache file,
+     *  checking the key unless it is null.
+     */
+    static bool mapLevels(const string &imagefile, const string &file, const ResourceView &view,
+    const GLuint64 *key, DecodedImage &image);
+    static bool enabled;
+};
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,62 @@
+/**********************************************************
+ *   TextureRegistry:  A class to share the texture objects
+ *   of the whole process.  A texture is found by the path
+ *   of its image or by a hash of the image's contents, so an
+ *   image used by many meshes and models is decoded and
+ *   uploaded once.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef TEXTUREREGISTRY_H
+#define TEXTUREREGISTRY_H
+
+#include "commonheader.h"
+#include <map>
+#include <mutex>
+
+//! \brief A shared texture object and the number of holders.
+struct RegisteredTexture {
+    GLuint id = 0;
+    GLuint64 key = 0;
+    int refs = 0;
+    //! The paths it was registered under.
+    vector<string> paths;
+};
+
+/** \class TextureRegistry Each acquire() or add() that returns a
+ *  texture is matched by one release(), the texture is deleted
+ *  with the last one.  The registry is process wide and locked,
+ *  so it may be used from any thread, the GL calls are made only
+ *  by release() on the thread of the context.
+ */
+class TextureRegistry
+{
+public:
+    //! \brief The texture of an image path, with a new reference, or zero.
+    static GLuint acquire(const string &imagefile);
+    /** \brief The texture of an image with the given content key,
+     *  with a new reference, or zero.  The path is remembered so
+     *  the next acquire() of it does not need the key.
+     */
+    static GLuint acquireContent(const string &imagefile, GLuint64 key);
+    //! \brief Register a new texture, holding one reference.
+    static void add(const string &imagefile, GLuint64 key, GLuint id);
+    //! \brief Drop a reference, the texture is deleted with the last.
+    static void release(GLuint id);
+    //! \brief True if the image path has a texture, no reference is taken.
+    static bool contains(const string &imagefile);
+    //! \brief The references held on a texture.
+    static int refCount(GLuint id);
+    //! \brief Print the textures held and the uploads saved.
+    static void printStats();
+protected:
+    static mutex lock;
+    static map<GLuint, RegisteredTexture> textures;
+    static map<string, GLuint> byPath;
+    static map<GLuint64, GLuint> byKey;
+    //! The acquires that found a texture, each an upload saved.
+    static int shared;
+};
+
+#endif // TEXTUREREGISTRY_H
@@ -0,0 +1,150 @@
+/**********************************************************
+ *   TextureStreamer:  A class to upload textures through a
+ *   pool of pixel buffer objects.  The mip chain is built on
+ *   the CPU and sent smallest level first, a few megabytes a
+ *   frame, so a texture can be drawn at low resolution at
+ *   once while the full resolution levels stream in.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "commonheader.h"
+#include "createimage.h"
+#include <chrono>
+#include <deque>
+#include <map>
+
+//! The number of pixel buffer objects in the pool.
+#define STREAM_BUFFERS 4
+//! The bytes started on in one update() call.
+#define STREAM_FRAME_BUDGET (8 * 1048576)
+//! Levels this size and smaller are sent at once, so the texture is never empty.
+#define STREAM_RESIDENT_SIZE 64
+
+/** \brief One level of one face or array layer, waiting to be
+ *  uploaded.
+ */
+struct StreamJob {
+    GLuint texture = 0;
+    //! The bind target and the target passed to glTexSubImage.
+    GLenum target = GL_TEXTURE_2D;
+    GLenum imageTarget = GL_TEXTURE_2D;
+    GLint level = 0;
+    //! The first array layer and the number of layers.
+    GLint layer = 0;
+    GLsizei width = 0, height = 0, depth = 1;
+    GLenum format = GL_RGBA;
+    //! The level's own pixels, or a level of a mapped cache file.
+    vector<unsigned char> pixels;
+    const unsigned char *data = nullptr;
+    shared_ptr<MappedFile> mapping;
+    GLsizeiptr size = 0;
+    const unsigned char *bytes() const
+    {
+        return data ? data : pixels.data();
+    }
+};
+
+//! \brief A pixel buffer object of the pool and the upload it carries.
+struct StreamSlot {
+    GLuint buffer = 0;
+    GLsizeiptr capacity = 0;
+    //! Set while the copy out of the buffer may be running.
+    GLsync fence = nullptr;
+    GLuint texture = 0;
+    GLint level = 0;
+};
+
+/** \brief The streaming state of a texture.  Its base level is
+ *  lowered as each level finishes, remaining counts the uploads
+ *  still due for each level.  Resident is the largest level that
+ *  was sent at once.
+ */
+struct StreamTexture {
+    GLenum target = GL_TEXTURE_2D;
+    GLint baseLevel = 0;
+    GLint resident = 0;
+    vector<int> remaining;
+};
+
+/** \class TextureStreamer Creates textures with immutable storage
+ *  (where ARB_texture_storage is available) and streams their mip
+ *  levels in through pixel buffer objects.  update() is called once
+ *  a frame, it retires the finished copies and starts new ones.
+ *  The caller sets the filter and wrap parameters as usual, the
+ *  streamer owns only GL_TEXTURE_BASE_LEVEL and GL_TEXTURE_MAX_LEVEL.
+ */
+class TextureStreamer
+{
+public:
+    //! \brief Create the pixel buffer pool.
+    TextureStreamer(int buffers = STREAM_BUFFERS, GLsizeiptr frameBudget = STREAM_FRAME_BUDGET);
+    //! \brief Delete the buffers and fences, queued uploads are dropped.
+    ~TextureStreamer();
+    //! \brief Create a 2D texture and queue its levels.
+    GLuint stream2D(const DecodedImage &image);
+    //! \brief Create a cube map from six faces, in the GL face order.
+    GLuint streamCube(const vector<DecodedImage> &faces);
+    //! \brief Create a 2D array texture, every layer the size of the first.
+    GLuint stream2DArray(const vector<DecodedImage> &layers);
+    /** \brief Build an array texture a layer at a time:  allocate it,
+     *  queue each layer as it is decoded, and finish it when all are
+     *  in, before it is drawn.
+     */
+    GLuint createArray(GLsizei width, GLsizei height, GLsizei depth);
+    void streamLayer(GLuint texture, GLint layer, const DecodedImage &image);
+    void finishArray(GLuint texture);
+    //! \brief Retire the finished uploads and start new ones, once a frame.
+    void update();
+    //! \brief Upload everything that is queued, waiting for it.
+    void finish();
+    //! \brief True when nothing is queued or in flight.
+    bool isIdle();
+    /** \brief Halve an image with a 2x2 box filter, the last row
+     *  or column of an odd size is dropped.
+     */
+    static void halveImage(const unsigned char *src, GLsizei width, GLsizei height,
+    unsigned char *dst, GLsizei dstWidth, GLsizei dstHeight);
+    //! \brief The full mip chain of an image, level 0 first.
+    static vector<vector<unsigned char>> buildMipChain(const unsigned char *pixels,
+    GLsizei width, GLsizei height);
+    //! \brief The number of levels in a full mip chain.
+    static GLint levelCount(GLsizei width, GLsizei height);
+    /** \brief Allocate the levels of the texture bound to target,
+     *  immutable where ARB_texture_storage is available.
+     */
+    static void allocate(GLenum target, GLint levels, GLsizei width, GLsizei height, GLsizei depth);
+protected:
+    /** \brief The jobs for the levels of one image, from its cached
+     *  chain or from one built here.
+     */
+    void imageJobs(const DecodedImage &image, GLuint texture, GLenum target, GLenum imageTarget,
+    vector<StreamJob> &jobs, GLint layer = 0);
+    //! \brief Start the streaming state of a texture, nothing is sent yet.
+    void track(GLuint texture, GLenum target, GLint levels);
+    //! \brief Send the small levels at once, to the bound texture, and queue the rest.
+    void enqueue(vector<StreamJob> &jobs);
+    //! \brief Set the base level of the bound texture to what has been sent.
+    void settle(GLuint texture);
+    //! \brief glTexSubImage for a job, from client memory or the bound buffer.
+    void upload(const StreamJob &job, const GLvoid *pixels);
+    //! \brief Copy a job into a free buffer and start its upload.
+    void start(StreamSlot &slot, StreamJob &job);
+    //! \brief A level of a texture finished, lower the base level if it can be.
+    void complete(GLuint texture, GLint level);
+    vector<StreamSlot> slots;
+    //! Waiting uploads, smallest first across all the textures.
+    deque<StreamJob> pending;
+    map<GLuint, StreamTexture> streaming;
+    GLsizeiptr frameBudget;
+    //! Timing of the current batch of uploads.
+    bool timing = false;
+    chrono::system_clock::time_point started;
+    //! Debug output.
+    bool debug1 = false;
+};
+
+#endif // TEXTURESTREAMER_H
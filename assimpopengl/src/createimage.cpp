@@ -8,6 +8,78 @@
  * ********************************************************/
 
 #include "../include/createimage.h"
+#include "../include/texturecache.h"
+#include "../include/texturestreamer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWIZZLE_X86 1
+#endif
+
+/** The kernels turn Free Image's BGRA pixels into RGBA and clear
+ *  the colour of pixels with zero alpha.  Each pixel is one 32 bit
+ *  word, B in the low byte on a little endian machine.  A source
+ *  and destination that are the same are allowed.
+ */
+static void swizzleScalar(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    for (size_t x = 0; x < count; x++)
+    {
+        uint32_t pixel;
+        memcpy(&pixel, src + x * 4, 4);
+        //! All ones when alpha is set, zero when it is not, no branch.
+        uint32_t keep = 0u - (uint32_t)((pixel >> 24) != 0);
+        pixel = (pixel & 0xFF00FF00u) | ((pixel & 0xFFu) << 16) | ((pixel >> 16) & 0xFFu);
+        pixel &= keep;
+        memcpy(dst + x * 4, &pixel, 4);
+    }
+}
+
+#ifdef SWIZZLE_X86
+__attribute__((target("ssse3")))
+static void swizzleSSSE3(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    const __m128i alpha = _mm_set1_epi32((int) 0xFF000000u);
+    const __m128i zero = _mm_setzero_si128();
+    size_t x = 0;
+    //! Four pixels at a time.
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        __m128i clear = _mm_cmpeq_epi32(_mm_and_si128(pixels, alpha), zero);
+        pixels = _mm_andnot_si128(clear, _mm_shuffle_epi8(pixels, order));
+        _mm_storeu_si128((__m128i*)(dst + x * 4), pixels);
+    }
+    swizzleScalar(src + x * 4, dst + x * 4, count - x);
+}
+
+__attribute__((target("avx2")))
+static void swizzleAVX2(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    //! The byte shuffle works within each 128 bit lane, so the pattern repeats.
+    const __m256i order = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    const __m256i alpha = _mm256_set1_epi32((int) 0xFF000000u);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t x = 0;
+    //! Eight pixels at a time.
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+        __m256i clear = _mm256_cmpeq_epi32(_mm256_and_si256(pixels, alpha), zero);
+        pixels = _mm256_andnot_si256(clear, _mm256_shuffle_epi8(pixels, order));
+        _mm256_storeu_si256((__m256i*)(dst + x * 4), pixels);
+    }
+    swizzleSSSE3(src + x * 4, dst + x * 4, count - x);
+}
+#endif
 
 CreateImage::CreateImage()
 {
@@ -17,19 +89,74 @@ CreateImage::CreateImage()
 CreateImage::~CreateImage()
 {
     cout << "\n\n\tDestroying CreateImage.\n\n";
-    delete pixels;
 }
 
 bool CreateImage::setImage(string imagefile)
 {
     //imagefile = "../images/" + imagefile;
+    return decodeImage(imagefile, image);
+}
+
+int CreateImage::bestKernel()
+{
+#ifdef SWIZZLE_X86
+    //! Checked once, the answer does not change.
+    static const int best = __builtin_cpu_supports("avx2") ? SWIZZLE_AVX2 
+    : (__builtin_cpu_supports("ssse3") ? SWIZZLE_SSSE3 : SWIZZLE_SCALAR);
+    return best;
+#else
+    return SWIZZLE_SCALAR;
+#endif
+}
+
+void CreateImage::swizzleMask(const unsigned char *src, unsigned char *dst, size_t count, int kernel)
+{
+    if (kernel == SWIZZLE_BEST)
+    {
+        kernel = bestKernel();
+    }
+#ifdef SWIZZLE_X86
+    if (kernel == SWIZZLE_AVX2)
+    {
+        swizzleAVX2(src, dst, count);
+        return;
+    }
+    if (kernel == SWIZZLE_SSSE3)
+    {
+        swizzleSSSE3(src, dst, count);
+        return;
+    }
+#endif
+    swizzleScalar(src, dst, count);
+}
+
+bool CreateImage::decodeImage(const string &imagefile, DecodedImage &image)
+{
+    //! Each call has its own Free Image Plus object, so threads do not share one.
+    fipImage txtImage;
+    image.path = imagefile;
+    image.ok = false;
+    image.levels.clear();
+    image.mapping.reset();
+    image.key = 0;
+    //! From the resource archive, the source file is not even opened.
+    if (TextureCache::loadArchived(imagefile, image))
+    {
+        return true;
+    }
+    //! A warm start maps the cached mip chain and decodes nothing.
+    GLuint64 key = 0;
+    //! The key is kept with the image, the texture registry shares textures by it.
+    bool keyed = TextureCache::contentKey(imagefile, key);
+    image.key = keyed ? key : 0;
+    bool cacheable = (TextureCache::isEnabled()) && (keyed);
+    if ((cacheable) && (TextureCache::load(imagefile, key, image)))
+    {
+        cout << "\n\n\tImage file " << imagefile << " mapped from the texture cache.\n\n";
+        return true;
+    }
     try
     {
-        //! Delete the item if it exists.
-        if (pixels)
-        {
-            delete(pixels);
-        }
         //! Free Image Plus Image loads standard picture.
         if (!txtImage.load(imagefile.c_str()))
         {
@@ -46,74 +173,198 @@ bool CreateImage::setImage(string imagefile)
         cout << "\n\n\tError loading file " << imagefile << " : " << exc.what() << "\n\n";
         return false;
     }
-    size = 0;
-    int counter = 0;
-    //! Convert image to four 8 bit fields RGBA.
+    //! Without alpha there is nothing to mask, so the BGRA rows are kept as they are.
+    bool opaque = (txtImage.getBitsPerPixel() != 32) && (!txtImage.isTransparent());
+    //! Convert image to four 8 bit fields.
     txtImage.convertTo32Bits();
-    width = (GLsizei) txtImage.getWidth();
-    height = (GLsizei) txtImage.getHeight();
-    size = width * height * 4;
-    line = width * 4;
-    ivec4 test;
+    image.width = (GLsizei) txtImage.getWidth();
+    image.height = (GLsizei) txtImage.getHeight();
+    image.format = opaque ? GL_BGRA : GL_RGBA;
+    size_t line = (size_t) image.width * 4;
+    //! The buffer is reused when the image is decoded into again.
+    image.pixels.resize(line * image.height);
+    unsigned char *pixels = image.pixels.data();
     // Load the image into an unsigned char array.
-    pixels = new unsigned char[size];
-    for (unsigned int y = 0; y < height; y++)
+    for (unsigned int y = 0; y < image.height; y++)
     {
-        picLine = txtImage.getScanLine(y);
-        for (unsigned int x = 0; x < line; x += 4)
+        BYTE *picLine = txtImage.getScanLine(y);
+        if (opaque)
         {
-            if (counter > size)
+            memcpy(pixels + y * line, picLine, line);
+        }
+        else
+        {
+            swizzleMask(picLine, pixels + y * line, image.width);
+        }
+    }
+    image.ok = true;
+    if (cacheable)
+    {
+        TextureCache::store(imagefile, key, image);
+    }
+    return true;
+}
+
+void CreateImage::decodeAll(vector<DecodedImage> &images)
+{
+    auto start = chrono::system_clock::now();
+    atomic<int> next(0);
+    int workers = std::min((int) thread::hardware_concurrency(), (int) images.size());
+    if (workers < 1)
+    {
+        workers = 1;
+    }
+    //! Each worker takes the next image until there are none left.
+    auto work = [&images, &next]()
+    {
+        for (int x = next++; x < images.size(); x = next++)
+        {
+            decodeImage(images[x].path, images[x]);
+        }
+    };
+    vector<thread> pool;
+    for (int x = 1; x < workers; x++)
+    {
+        pool.push_back(thread(work));
+    }
+    work();
+    for (int x = 0; x < pool.size(); x++)
+    {
+        pool[x].join();
+    }
+    auto finish = chrono::system_clock::now();
+    cout << "\n\n\tDecoded " << images.size() << " images on " << workers << " threads in "
+    << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << " ms.\n\n";
+}
+
+void CreateImage::decodeEach(vector<DecodedImage> &images, const function<void(int)> &ready)
+{
+    auto start = chrono::system_clock::now();
+    int workers = std::min((int) thread::hardware_concurrency(), (int) images.size());
+    if (workers < 1)
+    {
+        workers = 1;
+    }
+    //! Images being decoded or waiting for ready(), at most two a worker.
+    int limit = workers * 2;
+    int next = 0, outstanding = 0;
+    deque<int> done;
+    mutex lock;
+    condition_variable changed;
+    auto work = [&]()
+    {
+        while (true)
+        {
+            int x;
             {
-                continue;
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [&]() { return (outstanding < limit) || (next >= images.size()); });
+                if (next >= images.size())
+                {
+                    return;
+                }
+                x = next++;
+                outstanding++;
             }
-            test.x = counter;
-            pixels[counter++] = (unsigned char) picLine[x + 2];
-            test.y = counter;
-            pixels[counter++] = (unsigned char) picLine[x + 1];
-            test.z = counter;
-            pixels[counter++] = (unsigned char) picLine[x];
-            test.w = counter;
-            pixels[counter++] = (unsigned char) picLine[x + 3];
-            if (int(pixels[test.w]) == 0)
+            decodeImage(images[x].path, images[x]);
             {
-                pixels[test.x] = pixels[test.y] = pixels[test.z] = 0;
+                lock_guard<mutex> guard(lock);
+                done.push_back(x);
             }
-            
-                
+            changed.notify_all();
+        }
+    };
+    vector<thread> pool;
+    for (int x = 0; x < workers; x++)
+    {
+        pool.push_back(thread(work));
+    }
+    //! The calling thread has the GL context, it takes the images as they come.
+    for (int count = 0; count < images.size(); count++)
+    {
+        int x;
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&]() { return !done.empty(); });
+            x = done.front();
+            done.pop_front();
         }
+        ready(x);
+        vector<unsigned char>().swap(images[x].pixels);
+        images[x].levels.clear();
+        images[x].mapping.reset();
+        {
+            lock_guard<mutex> guard(lock);
+            outstanding--;
+        }
+        changed.notify_all();
     }
-    return true;
+    for (int x = 0; x < pool.size(); x++)
+    {
+        pool[x].join();
+    }
+    auto finish = chrono::system_clock::now();
+    cout << "\n\n\tDecoded and took " << images.size() << " images on " << workers << " threads in "
+    << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << " ms.\n\n";
 }
 
 //! Accessor functions to pass along the data.
 GLsizei CreateImage::getWidth()
 {
-    return width;
+    return image.width;
 }
 
 GLsizei CreateImage::getHeight()
 {
-    return height;
+    return image.height;
 }
 
 GLvoid *CreateImage::getData()
 {
-    return (GLvoid*) pixels;
+    return (GLvoid*) image.level(0);
+}
+
+GLenum CreateImage::getFormat()
+{
+    return image.format;
 }
 
 //! Use the CreateImage class to turn an image into a texture.
 GLuint CreateImage::textureObject()
+{
+    return textureObject(image, streamer);
+}
+
+void CreateImage::setStreamer(TextureStreamer *streamer)
+{
+    this->streamer = streamer;
+}
+
+GLuint CreateImage::textureObject(const DecodedImage &image, TextureStreamer *streamer)
 {
     //Generate texture ID and load texture data 
     GLuint textureID;
-    glGenTextures(1, &textureID);
-    GLsizei width, height;
-    width = getWidth();
-    height = getHeight();
-    GLvoid *image = getData();
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);    
+    if (streamer)
+    {
+        //! The small levels are there at once, the rest arrive over the next frames.
+        textureID = streamer->stream2D(image);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+    }
+    else
+    {
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        //! A cached image brings its mip chain, otherwise the driver makes one.
+        for (int x = 0; x < image.levelCount(); x++)
+        {
+            glTexImage2D(GL_TEXTURE_2D, x, GL_RGBA, std::max(image.width >> x, 1), std::max(image.height >> x, 1), 
+            0, image.format, GL_UNSIGNED_BYTE, image.level(x));
+        }
+        if (image.levelCount() == 1)
+        {
+            glGenerateMipmap(GL_TEXTURE_2D);    
+        }
+    }
     // Parameters
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
@@ -133,28 +384,52 @@ void CreateImage::createSkyBoxTex(GLuint &textureID, string filenames[6])
     // -Y (bottom)
     // +Z (front) 
     // -Z (back)
-    GLsizei width, height;
-    void *pixel_data = nullptr;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-    //! Six images, one texture ID.
+    vector<DecodedImage> faces(6);
     for (int i = 0; i < 6; i++)
     {
-        //! The order of images in a skybox is reversed.\n\n';
-        if (setImage(filenames[i]))
+        faces[i].path = filenames[i];
+    }
+    decodeAll(faces);
+    createSkyBoxTex(textureID, faces);
+}
+
+//! The faces were decoded already, perhaps on a loading thread.
+void CreateImage::createSkyBoxTex(GLuint &textureID, const vector<DecodedImage> &faces)
+{
+    if (streamer)
+    {
+        textureID = streamer->streamCube(faces);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    }
+    else
+    {
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        //! Six images, one texture ID.
+        bool baked = true;
+        for (int i = 0; i < 6; i++)
         {
-            width = getWidth();
-            height = getHeight();
-            pixel_data = getData();
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel_data);
+            //! The order of images in a skybox is reversed.
+            if (faces[i].ok)
+            {
+                for (int x = 0; x < faces[i].levelCount(); x++)
+                {
+                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, x, GL_RGBA, std::max(faces[i].width >> x, 1), 
+                    std::max(faces[i].height >> x, 1), 0, faces[i].format, GL_UNSIGNED_BYTE, faces[i].level(x));
+                }
+                baked = baked && (faces[i].levelCount() > 1);
+            }
+            else
+            {
+                cout << "\n\n\tImage load failure.  "
+                << "Only a partial load is present.\n\n";
+            }
         }
-        else
+        if (!baked)
         {
-            cout << "\n\n\tImage load failure.  "
-            << "Only a partial load is present.\n\n";
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);    
         }
     }
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);    
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -166,42 +441,115 @@ void CreateImage::createSkyBoxTex(GLuint &textureID, string filenames[6])
 }
 void CreateImage::create2DTexArray(GLuint &textureID,  vector<string>filenames)
 {
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
-    int count = 0;
-    if (setImage(filenames[0]))
+    vector<DecodedImage> layers(filenames.size());
+    for (int i = 0; i < filenames.size(); i++)
     {
-        unsigned char *pixel_data = new unsigned char[size * filenames.size()];
-        for (int x = 0 * size; x < size; x++)
-        {
-            pixel_data[count++] = pixels[x];
-        }
-        for (int i = 1; i < filenames.size(); i++)
+        layers[i].path = filenames[i];
+    }
+    textureID = 0;
+    GLsizei width = 0, height = 0;
+    bool ok = (layers.size() > 0), baked = true;
+    /** The storage is allocated for the first layer decoded, and
+     *  each layer is uploaded into it as it arrives and then freed.
+     */
+    decodeEach(layers, [&](int i)
+    {
+        uploadLayer(textureID, layers[i], i, layers.size(), width, height, ok, baked);
+    });
+    finishTexArray(textureID, ok, baked);
+}
+
+//! The layers were decoded already, perhaps on a loading thread.
+void CreateImage::create2DTexArray(GLuint &textureID, const vector<DecodedImage> &layers)
+{
+    textureID = 0;
+    GLsizei width = 0, height = 0;
+    bool ok = (layers.size() > 0), baked = true;
+    for (int i = 0; i < layers.size(); i++)
+    {
+        uploadLayer(textureID, layers[i], i, layers.size(), width, height, ok, baked);
+    }
+    finishTexArray(textureID, ok, baked);
+}
+
+void CreateImage::uploadLayer(GLuint &textureID, const DecodedImage &layer, int i, GLsizei depth,
+GLsizei &width, GLsizei &height, bool &ok, bool &baked)
+{
+    if (!layer.ok)
+    {
+        ok = false;
+        return;
+    }
+    if (textureID == 0)
+    {
+        width = layer.width;
+        height = layer.height;
+        if (streamer)
         {
-            setImage(filenames[i]);
-            for (int x = 0; x < size; x++)
-            {
-                pixel_data[count++] = pixels[x];
-            }
+            textureID = streamer->createArray(width, height, depth);
         }
-        if (debug1)
+        else
         {
-            cout << "\n\n\tPixels loaded:  " << count 
-            << "  Pixels calculated:  " << filenames.size() * size << "\n\n";
+            glGenTextures(1, &textureID);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+            TextureStreamer::allocate(GL_TEXTURE_2D_ARRAY, TextureStreamer::levelCount(width, height),
+            width, height, depth);
         }
-        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, width, height, filenames.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*) pixel_data);
-        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_REPEAT);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     }
-    else
+    //! Every layer of an array texture has the size of the first.
+    if ((layer.width != width) || (layer.height != height))
+    {
+        cout << "\n\n\tImage " << layer.path << " is " << layer.width << " x " << layer.height 
+        << ", the texture array is " << width << " x " << height << ".\n\n";
+        ok = false;
+        return;
+    }
+    if (streamer)
+    {
+        streamer->streamLayer(textureID, i, layer);
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    //! Each upload has its own format, so RGBA and BGRA layers mix freely.
+    for (int x = 0; x < layer.levelCount(); x++)
+    {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, x, 0, 0, i, std::max(width >> x, 1), std::max(height >> x, 1), 1, 
+        layer.format, GL_UNSIGNED_BYTE, layer.level(x));
+    }
+    baked = baked && (layer.levelCount() > 1);
+    if (debug1)
+    {
+        cout << "\n\n\tLayer " << i << " uploaded:  " << layer.path << "\n\n";
+    }
+}
+
+void CreateImage::finishTexArray(GLuint textureID, bool ok, bool baked)
+{
+    if (textureID == 0)
+    {
+        cout << "\n\n\tImage load failure.  "
+        << "No texture array was made.\n\n";
+        return;
+    }
+    if (!ok)
     {
         cout << "\n\n\tImage load failure.  "
         << "Only a partial load is present.\n\n";
     }
+    if (streamer)
+    {
+        streamer->finishArray(textureID);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    if ((!streamer) && (!baked))
+    {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
     return;
 }
@@ -0,0 +1,90 @@
+/**********************************************************
+ *   imagebench:  Times the BGRA to RGBA swizzle kernels of
+ *   CreateImage on the sky box images, and the decode of
+ *   each image as a whole, with and without the texture
+ *   cache.  Built only on request:
+ *   make imagebench
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/createimage.h"
+#include "../include/texturecache.h"
+#include <chrono>
+#include <cstring>
+
+//! The times each kernel runs over an image.
+#define BENCH_PASSES 20
+
+int main(int argc, char **argv)
+{
+    vector<string> files;
+    for (int x = 1; x < argc; x++)
+    {
+        files.push_back(argv[x]);
+    }
+    if (files.empty())
+    {
+        string dir = "/usr/share/openglresources/objects/images/skybox/";
+        string names[6] = { "right.jpg", "left.jpg", "top.jpg", "bottom.jpg", "front.jpg", "back.jpg" };
+        for (int x = 0; x < 6; x++)
+        {
+            files.push_back(dir + names[x]);
+        }
+    }
+    const char *kernelNames[3] = { "scalar", "SSSE3", "AVX2" };
+    int best = CreateImage::bestKernel();
+    cout << "\n\n\tBest kernel on this CPU:  " << kernelNames[best] << "\n\n";
+    vector<unsigned char> source, staging;
+    for (int x = 0; x < files.size(); x++)
+    {
+        fipImage txtImage;
+        if (!txtImage.load(files[x].c_str()))
+        {
+            cout << "\n\n\tImage file " << files[x] << " failed to load.\n\n";
+            continue;
+        }
+        txtImage.convertTo32Bits();
+        size_t line = (size_t) txtImage.getWidth() * 4;
+        size_t count = (size_t) txtImage.getWidth() * txtImage.getHeight();
+        source.resize(count * 4);
+        staging.resize(count * 4);
+        for (unsigned int y = 0; y < txtImage.getHeight(); y++)
+        {
+            memcpy(source.data() + y * line, txtImage.getScanLine(y), line);
+        }
+        cout << "\n\t" << files[x] << "  " << txtImage.getWidth() << " x " << txtImage.getHeight();
+        vector<unsigned char> reference;
+        for (int kernel = SWIZZLE_SCALAR; kernel <= best; kernel++)
+        {
+            auto start = chrono::steady_clock::now();
+            for (int pass = 0; pass < BENCH_PASSES; pass++)
+            {
+                CreateImage::swizzleMask(source.data(), staging.data(), count, kernel);
+            }
+            auto finish = chrono::steady_clock::now();
+            double ms = chrono::duration<double, milli>(finish - start).count() / BENCH_PASSES;
+            if (reference.empty())
+            {
+                reference = staging;
+            }
+            bool same = (memcmp(reference.data(), staging.data(), staging.size()) == 0);
+            cout << "\n\t\t" << kernelNames[kernel] << ":  " << ms << " ms  " 
+            << (count * 4 / 1048576.0) / (ms / 1000.0) << " MB/s" << (same ? "" : "  MISMATCH");
+        }
+        //! Without the cache, then with it twice, the first of which fills it if it is cold.
+        const char *passNames[3] = { "Whole decode:  ", "Cache, first:  ", "Cache, second:  " };
+        for (int pass = 0; pass < 3; pass++)
+        {
+            TextureCache::setEnabled(pass > 0);
+            DecodedImage image;
+            auto start = chrono::steady_clock::now();
+            CreateImage::decodeImage(files[x], image);
+            auto finish = chrono::steady_clock::now();
+            cout << "\n\t\t" << passNames[pass] << chrono::duration<double, milli>(finish - start).count()
+            << " ms, uploaded as " << ((image.format == GL_BGRA) ? "GL_BGRA" : "GL_RGBA");
+        }
+    }
+    cout << "\n\n";
+    return 0;
+}
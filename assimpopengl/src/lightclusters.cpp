@@ -0,0 +1,247 @@
+/**********************************************************
+ *   LightClusters:  A class to split the view into clusters
+ *   and list, for each cluster, the lights that reach into
+ *   it, so a fragment is lit only by the lights near it.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/lightclusters.h"
+#include <cfloat>
+#include <cmath>
+
+static_assert(sizeof(LightBlock) == 16 + CLUSTER_POINT_LIGHTS * 64 + CLUSTER_SPOT_LIGHTS * 96,
+"LightBlock must match std140");
+
+LightClusters::LightClusters()
+{
+    cout << "\n\n\tCreating LightClusters.\n\n";
+    glGenTextures(RING_REGIONS, gridTextures);
+    glGenTextures(RING_REGIONS, indexTextures);
+    for (int x = 0; x < RING_REGIONS; x++)
+    {
+        glBindTexture(GL_TEXTURE_2D, gridTextures[x]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, 0,
+        GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);
+        integerSampling();
+        glBindTexture(GL_TEXTURE_2D, indexTextures[x]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, CLUSTER_INDEX_WIDTH, CLUSTER_INDEX_ROWS, 0,
+        GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        integerSampling();
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    block.clusterScale = vec4(1.0f, 1.0f, nearPlane, sliceScale);
+}
+
+LightClusters::~LightClusters()
+{
+    cout << "\n\n\tDestroying LightClusters.\n\n";
+    glDeleteTextures(RING_REGIONS, gridTextures);
+    glDeleteTextures(RING_REGIONS, indexTextures);
+}
+
+void LightClusters::integerSampling()
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+int LightClusters::depthSlice(float depth)
+{
+    if (depth <= nearPlane)
+    {
+        return 0;
+    }
+    int slice = (int)floor(log(depth / nearPlane) * sliceScale);
+    return std::min(slice, CLUSTER_Z - 1);
+}
+
+bool LightClusters::clusterBounds(const vec3 &position, float range, int *bound)
+{
+    int *lower = bound, *upper = bound + 3;
+    lower[0] = lower[1] = lower[2] = 0;
+    upper[0] = CLUSTER_X - 1;
+    upper[1] = CLUSTER_Y - 1;
+    upper[2] = CLUSTER_Z - 1;
+    if (range <= 0.0f)
+    {
+        return true;
+    }
+    //! The camera looks down -z in view space.
+    vec4 center = view * vec4(position, 1.0f);
+    float nearest = -center.z - range, farthest = -center.z + range;
+    if ((farthest < nearPlane) || (nearest > farPlane))
+    {
+        upper[2] = -1;
+        return false;
+    }
+    lower[2] = depthSlice(nearest);
+    upper[2] = depthSlice(farthest);
+    //! A sphere across the near plane may cover any part of the screen.
+    if (nearest <= nearPlane)
+    {
+        return true;
+    }
+    /** The box around the sphere, its corners projected at its nearest
+     *  and its farthest depth, holds the whole of its projection.
+     */
+    float scale[2] = { projection[0][0], projection[1][1] };
+    int tiles[2] = { CLUSTER_X, CLUSTER_Y };
+    for (int y = 0; y < 2; y++)
+    {
+        float low = FLT_MAX, high = -FLT_MAX;
+        for (float side : { -range, range })
+        {
+            for (float depth : { nearest, farthest })
+            {
+                float ndc = scale[y] * (center[y] + side) / depth;
+                low = std::min(low, ndc);
+                high = std::max(high, ndc);
+            }
+        }
+        if ((high < -1.0f) || (low > 1.0f))
+        {
+            upper[2] = -1;
+            return false;
+        }
+        lower[y] = std::max(0, (int)floor((low * 0.5f + 0.5f) * tiles[y]));
+        upper[y] = std::min(tiles[y] - 1, (int)floor((high * 0.5f + 0.5f) * tiles[y]));
+    }
+    return true;
+}
+
+void LightClusters::countLight(const int *bound, vector<GLuint> &counts)
+{
+    for (int z = bound[2]; z <= bound[5]; z++)
+    {
+        for (int y = bound[1]; y <= bound[4]; y++)
+        {
+            for (int x = bound[0]; x <= bound[3]; x++)
+            {
+                counts[x + (y + z * CLUSTER_Y) * CLUSTER_X]++;
+            }
+        }
+    }
+}
+
+void LightClusters::update(const mat4 &view, const mat4 &projection, int width, int height,
+const vector<PointLight> &lights, const vector<SpotLight> &spotLights)
+{
+    this->view = view;
+    this->projection = projection;
+    //! The planes of a perspective projection, from its depth terms.
+    nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+    farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    sliceScale = (float)CLUSTER_Z / log(farPlane / nearPlane);
+    block.clusterScale = vec4((float)width, (float)height, nearPlane, sliceScale);
+    int points = std::min((int)lights.size(), CLUSTER_POINT_LIGHTS);
+    int spots = std::min((int)spotLights.size(), CLUSTER_SPOT_LIGHTS);
+    bounds.resize((points + spots) * 6);
+    pointCounts.assign(CLUSTER_COUNT, 0);
+    spotCounts.assign(CLUSTER_COUNT, 0);
+    for (int x = 0; x < points; x++)
+    {
+        RingBuffer::fillPointLight(block.pointLights[x], lights[x]);
+        if (clusterBounds(lights[x].position, lights[x].range, &bounds[x * 6]))
+        {
+            countLight(&bounds[x * 6], pointCounts);
+        }
+    }
+    for (int x = 0; x < spots; x++)
+    {
+        RingBuffer::fillSpotLight(block.spotLights[x], spotLights[x]);
+        if (clusterBounds(spotLights[x].position, spotLights[x].range, &bounds[(points + x) * 6]))
+        {
+            countLight(&bounds[(points + x) * 6], spotCounts);
+        }
+    }
+    //! Each cluster's list follows the one before, cut short when the index texture is full.
+    grid.assign(CLUSTER_COUNT * 4, 0);
+    GLuint offset = 0;
+    largest = 0;
+    dropped = 0;
+    for (int x = 0; x < CLUSTER_COUNT; x++)
+    {
+        GLuint room = CLUSTER_INDEX_WIDTH * CLUSTER_INDEX_ROWS - offset;
+        GLuint pointCount = std::min(pointCounts[x], room);
+        GLuint spotCount = std::min(spotCounts[x], room - pointCount);
+        dropped += pointCounts[x] + spotCounts[x] - pointCount - spotCount;
+        grid[x * 4] = offset;
+        grid[x * 4 + 1] = pointCount;
+        grid[x * 4 + 2] = spotCount;
+        offset += pointCount + spotCount;
+        largest = std::max(largest, pointCount + spotCount);
+    }
+    indexCount = offset;
+    GLsizei rows = (indexCount + CLUSTER_INDEX_WIDTH - 1) / CLUSTER_INDEX_WIDTH;
+    indices.assign(rows * CLUSTER_INDEX_WIDTH, 0);
+    //! The point lights all come first, so they fill the front of each list.
+    filled.assign(CLUSTER_COUNT, 0);
+    for (int x = 0; x < points + spots; x++)
+    {
+        const int *bound = &bounds[x * 6];
+        bool spot = (x >= points);
+        for (int cz = bound[2]; cz <= bound[5]; cz++)
+        {
+            for (int cy = bound[1]; cy <= bound[4]; cy++)
+            {
+                for (int cx = bound[0]; cx <= bound[3]; cx++)
+                {
+                    int cluster = cx + (cy + cz * CLUSTER_Y) * CLUSTER_X;
+                    const GLuint *cell = &grid[cluster * 4];
+                    GLuint limit = spot ? cell[1] + cell[2] : cell[1];
+                    if (filled[cluster] < limit)
+                    {
+                        indices[cell[0] + filled[cluster]++] = spot ? x - points : x;
+                    }
+                }
+            }
+        }
+    }
+    current = (current + 1) % RING_REGIONS;
+    bindTextures();
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_UNIT);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_X * CLUSTER_Y, CLUSTER_Z,
+    GL_RGBA_INTEGER, GL_UNSIGNED_INT, grid.data());
+    if (rows > 0)
+    {
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_INDEX_UNIT);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CLUSTER_INDEX_WIDTH, rows,
+        GL_RED_INTEGER, GL_UNSIGNED_INT, indices.data());
+    }
+    if (debug1)
+    {
+        cout << "\n\tLight clusters:  " << indexCount << " indices, " << largest << " at most.";
+    }
+}
+
+GLintptr LightClusters::writeBlock(RingBuffer *ring)
+{
+    return ring->writeUniform(&block, sizeof(LightBlock));
+}
+
+void LightClusters::bindTextures()
+{
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_UNIT);
+    glBindTexture(GL_TEXTURE_2D, gridTextures[current]);
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_INDEX_UNIT);
+    glBindTexture(GL_TEXTURE_2D, indexTextures[current]);
+}
+
+void LightClusters::setupShader(Shader *shader)
+{
+    shader->bindBlock("LightData", LIGHT_BLOCK_BINDING);
+    shader->Use();
+    shader->setInt("clusterGrid", CLUSTER_GRID_UNIT);
+    shader->setInt("lightIndices", CLUSTER_INDEX_UNIT);
+}
+
+void LightClusters::printStats()
+{
+    cout << "\n\n\tLight Clusters:  " << CLUSTER_X << " x " << CLUSTER_Y << " x " << CLUSTER_Z
+    << ", " << indexCount << " of " << CLUSTER_INDEX_WIDTH * CLUSTER_INDEX_ROWS << " light indices, "
+    << largest << " lights in the fullest cluster, " << dropped << " dropped.\n\n";
+}
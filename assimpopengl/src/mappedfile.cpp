@@ -0,0 +1,82 @@
+/**********************************************************
+ *   MappedFile:  A class to map a file read only into
+ *   memory, so cached data is used in place rather than
+ *   read and copied.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/mappedfile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const string &file)
+{
+    close();
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (info.st_size <= 0))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    //! The mapping holds its own reference to the file.
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        cout << "\n\n\tCould not map " << file << ".\n\n";
+        return false;
+    }
+    base = mapped;
+    length = info.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (base)
+    {
+        munmap(base, length);
+        base = nullptr;
+        length = 0;
+    }
+}
+
+const unsigned char *MappedFile::data() const
+{
+    return (const unsigned char *)base;
+}
+
+size_t MappedFile::size() const
+{
+    return length;
+}
+
+bool MappedFile::isOpen() const
+{
+    return (base != nullptr);
+}
+
+void MappedFile::willNeed() const
+{
+    if (base)
+    {
+        madvise(base, length, MADV_WILLNEED);
+    }
+}
@@ -10,10 +10,16 @@
  * ********************************************************/
 
 #include "../include/mesh.h"
+#include <cfloat>
+#include <cmath>
 
+bool Mesh::packing = false;
+
+//! The layout is fixed when the mesh is built, so its variant is known before the upload.
 Mesh::Mesh()
 {
     cout << "\n\n\tCreating Mesh.\n\n";
+    packed = packing;
     return;
 }
 
@@ -47,7 +53,110 @@ void Mesh::setData(Vertex1 *vertices, GLuint *indices, int vertSize, int indexSi
     return;
 }
 
-void Mesh::Draw(Shader *shader, glm::mat4 view, glm::mat4 projection, glm::mat4 model, vector<PointLight> lights, vector<SpotLight>spotLights, vec3 viewPos, int startIndex, bool diffOnly) 
+void Mesh::setUniforms(Shader *shader, const glm::mat4 *model, int startIndex)
+{
+    cout << "\n\nIn abstract class.\n";
+    return;
+}
+
+void Mesh::setInstanceBuffer(GLuint buffer, GLintptr offset)
+{
+    cout << "\n\nIn abstract class.\n";
+    return;
+}
+
+GLuint Mesh::getFeatures(bool diffOnly)
+{
+    cout << "\n\nIn abstract class.\n";
+    return 0;
+}
+
+//! A mat4 attribute takes four vec4 locations, advanced once per instance.
+void Mesh::instanceAttributes(GLuint vao, GLuint buffer, GLintptr offset)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (int x = 0; x < 4; x++)
+    {
+        glVertexAttribPointer(4 + x, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(offset + x * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(4 + x);
+        glVertexAttribDivisor(4 + x, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+//! Only a textured mesh has textures.
+void Mesh::setTextureId(int index, GLuint id)
+{
+    return;
+}
+
+int Mesh::selectLod(float pixelsPerUnit)
+{
+    return MeshSimplifier::selectLod(lods, pixelsPerUnit);
+}
+
+void Mesh::lodRange(int lod, GLsizei indexSize, GLint &first, GLsizei &count)
+{
+    first = range.firstIndex;
+    count = indexSize;
+    if ((lod >= 0) && (lod < lods.size()))
+    {
+        first += lods[lod].firstIndex;
+        count = lods[lod].indexCount;
+    }
+    else if (!lods.empty())
+    {
+        count = lods[0].indexCount;
+    }
+}
+
+int Mesh::getArena()
+{
+    return range.arena;
+}
+
+void Mesh::uploadMesh(int layout, const GLvoid *vertices, int vertSize, const GLuint *indices,
+int indexSize, GLuint &VAO, GLuint &VBO, GLuint &EBO)
+{
+    if (pool)
+    {
+        //! The pool owns the buffers and the vertex array.
+        range = pool->allocate(layout, vertices, vertSize, indices, indexSize);
+        VAO = range.vao;
+        VBO = EBO = 0;
+        return;
+    }
+    range = MeshRange();
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertSize * MeshPool::vertexSize(layout), vertices, GL_STATIC_DRAW);  
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize * sizeof(GLuint), indices, GL_STATIC_DRAW);
+    MeshPool::vertexAttributes(layout);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    range.vao = VAO;
+}
+
+void Mesh::freeMesh(GLuint &VAO, GLuint &VBO, GLuint &EBO)
+{
+    if (!pool)
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+    }
+    VAO = VBO = EBO = 0;
+}
+
+void Mesh::fillItem(RenderItem &item, int startIndex, int lod)
 {
     cout << "\n\nIn abstract class.\n";
     return;
@@ -62,3 +171,117 @@ string Mesh::getType()
 {
     return type;
 }
+
+void Mesh::setPacking(bool packing)
+{
+    Mesh::packing = packing;
+}
+
+bool Mesh::isPacking()
+{
+    return packing;
+}
+
+/** The direction is projected onto the octahedron |x| + |y| + |z| = 1
+ *  and the lower half is folded over the upper, so two values hold it.
+ *  The shader reverses this in octDecode().
+ */
+void Mesh::packDirection(const float *direction, GLshort *packed)
+{
+    float sum = fabs(direction[0]) + fabs(direction[1]) + fabs(direction[2]);
+    if (sum <= 0.0f)
+    {
+        packed[0] = packed[1] = 0;
+        return;
+    }
+    float x = direction[0] / sum;
+    float y = direction[1] / sum;
+    if (direction[2] < 0.0f)
+    {
+        float foldX = (1.0f - fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldY = (1.0f - fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldX;
+        y = foldY;
+    }
+    packed[0] = (GLshort)lround(fmax(-1.0f, fmin(1.0f, x)) * 32767.0f);
+    packed[1] = (GLshort)lround(fmax(-1.0f, fmin(1.0f, y)) * 32767.0f);
+}
+
+void Mesh::packBounds(const float *vertices, int stride, int count, int texCoord)
+{
+    float low[5] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+    float high[5] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+    int values = texCoord < 0 ? 3 : 5;
+    for (int x = 0; x < count; x++)
+    {
+        const float *vertex = vertices + (x * stride);
+        for (int y = 0; y < values; y++)
+        {
+            float value = y < 3 ? vertex[y] : vertex[texCoord + y - 3];
+            low[y] = fmin(low[y], value);
+            high[y] = fmax(high[y], value);
+        }
+    }
+    if (count == 0)
+    {
+        for (int y = 0; y < 5; y++)
+        {
+            low[y] = high[y] = 0.0f;
+        }
+    }
+    //! A flat extent still gets a scale, so the division is safe.
+    float extent[5];
+    for (int y = 0; y < 5; y++)
+    {
+        extent[y] = high[y] > low[y] ? high[y] - low[y] : 1.0f;
+    }
+    positionOffset = vec3(low[0], low[1], low[2]);
+    positionScale = vec3(extent[0], extent[1], extent[2]);
+    uvOffset = vec2(low[3], low[4]);
+    uvScale = vec2(extent[3], extent[4]);
+    if (texCoord < 0)
+    {
+        uvOffset = vec2(0.0f);
+        uvScale = vec2(1.0f);
+    }
+}
+
+void Mesh::packPosition(const float *position, GLushort *packed)
+{
+    const float offset[3] = {positionOffset.x, positionOffset.y, positionOffset.z};
+    const float scale[3] = {positionScale.x, positionScale.y, positionScale.z};
+    for (int x = 0; x < 3; x++)
+    {
+        float unit = (position[x] - offset[x]) / scale[x];
+        packed[x] = (GLushort)lround(fmax(0.0f, fmin(1.0f, unit)) * 65535.0f);
+    }
+    packed[3] = 0;
+}
+
+void Mesh::packTexCoords(const float *texCoords, GLushort *packed)
+{
+    const float offset[2] = {uvOffset.x, uvOffset.y};
+    const float scale[2] = {uvScale.x, uvScale.y};
+    for (int x = 0; x < 2; x++)
+    {
+        float unit = (texCoords[x] - offset[x]) / scale[x];
+        packed[x] = (GLushort)lround(fmax(0.0f, fmin(1.0f, unit)) * 65535.0f);
+    }
+}
+
+//! The packing bounds, the derived classes add their color and shininess.
+void Mesh::fillDrawData(DrawData &data)
+{
+    data.color = vec4(1.0f, 1.0f, 1.0f, opacity);
+    data.positionOffset = vec4(positionOffset, 1.0f);
+    data.positionScale = vec4(positionScale, 1.0f);
+    data.uvTransform = vec4(uvOffset.x, uvOffset.y, uvScale.x, uvScale.y);
+}
+
+void Mesh::setPackedUniforms(Shader *shader)
+{
+    shader->setVec3("positionOffset", positionOffset);
+    shader->setVec3("positionScale", positionScale);
+    shader->setVec2("uvOffset", uvOffset);
+    shader->setVec2("uvScale", uvScale);
+}
@@ -0,0 +1,389 @@
+/**********************************************************
+ *   MeshCache:  A class to keep the meshes of an asset file,
+ *   as assimp and the Model class left them, in a binary
+ *   cache file.  Later starts map the file and upload the
+ *   vertices and indices straight from it, assimp is not run.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/meshcache.h"
+#include "../include/meshtex.h"
+#include "../include/meshvert.h"
+#include "../include/meshoptimizer.h"
+#include "../include/shader.h"
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+
+bool MeshCache::enabled = true;
+
+void MeshCache::setEnabled(bool enabled)
+{
+    MeshCache::enabled = enabled;
+}
+
+bool MeshCache::isEnabled()
+{
+    return enabled;
+}
+
+bool MeshCache::hashFile(const string &file, GLuint64 &key, string *contents)
+{
+    FILE *source = fopen(file.c_str(), "rb");
+    if (!source)
+    {
+        return false;
+    }
+    vector<unsigned char> block(65536);
+    size_t got;
+    while ((got = fread(block.data(), 1, block.size(), source)) > 0)
+    {
+        key = Shader::hashBytes(block.data(), got, key);
+        if (contents)
+        {
+            contents->append((const char *)block.data(), got);
+        }
+    }
+    fclose(source);
+    return true;
+}
+
+bool MeshCache::contentKey(const string &asset, GLuint flags, GLuint maps, GLuint64 &key)
+{
+    key = FNV_OFFSET;
+    string ext = path(asset).extension().string();
+    bool obj = (ext == ".obj") || (ext == ".OBJ");
+    string contents;
+    if (!hashFile(asset, key, obj ? &contents : nullptr))
+    {
+        return false;
+    }
+    //! An .obj keeps its materials in the libraries it names, they are part of the key.
+    istringstream lines(contents);
+    string line;
+    string directory = asset.substr(0, asset.find_last_of('/'));
+    while ((obj) && (getline(lines, line)))
+    {
+        if (line.compare(0, 7, "mtllib ") != 0)
+        {
+            continue;
+        }
+        string library = line.substr(7);
+        while ((!library.empty()) && (isspace((unsigned char)library.back())))
+        {
+            library.pop_back();
+        }
+        if (!hashFile(directory + "/" + library, key))
+        {
+            key = Shader::hashBytes(library.data(), library.size(), key);
+        }
+    }
+    //! The optimized order is what is stored, so the optimizer is part of the key.
+    GLuint optimizer = MeshOptimizer::isEnabled() ? MESH_OPTIMIZER_VERSION : 0;
+    GLuint simplifier = MeshSimplifier::isEnabled() ? MESH_LOD_VERSION : 0;
+    GLuint layout[7] = { MESH_CACHE_VERSION, flags, maps, optimizer, simplifier,
+    (GLuint)sizeof(Vertex), (GLuint)sizeof(Vertex1) };
+    key = Shader::hashBytes(layout, sizeof(layout), key);
+    return true;
+}
+
+string MeshCache::cacheFile(const string &asset, GLuint64 key, string &prefix)
+{
+    const char *home = getenv("HOME");
+    if (!home)
+    {
+        return string();
+    }
+    //! Assets of the same name in different directories get their own files.
+    GLuint64 where = Shader::hashBytes(asset.data(), asset.size(), FNV_OFFSET);
+    char hex[32];
+    snprintf(hex, sizeof(hex), "%08x-", (unsigned int)(where & 0xFFFFFFFF));
+    prefix = path(asset).stem().string() + "-" + hex;
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+    return string(home) + "/.config/assimpopengl/meshcache/" + prefix + hex + ".msh";
+}
+
+//! The strings are padded so everything after them stays four byte aligned.
+static void putString(vector<unsigned char> &out, const string &text)
+{
+    size_t start = out.size();
+    out.insert(out.end(), text.begin(), text.end());
+    out.resize(start + ((text.size() + 3) & ~(size_t)3), 0);
+}
+
+static void putBytes(vector<unsigned char> &out, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+bool MeshCache::store(const string &asset, GLuint64 key, const vector<MeshInfo> &meshes)
+{
+    string prefix;
+    string file = cacheFile(asset, key, prefix);
+    if (file.empty())
+    {
+        return false;
+    }
+    vector<unsigned char> contents;
+    MeshCacheHeader header;
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.key = key;
+    header.meshes = meshes.size();
+    header.version = MESH_CACHE_VERSION;
+    putBytes(contents, &header, sizeof(header));
+    for (int x = 0; x < meshes.size(); x++)
+    {
+        MeshCacheEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        MeshTex *textured = dynamic_cast<MeshTex*>(meshes[x].mesh);
+        MeshVert *plain = dynamic_cast<MeshVert*>(meshes[x].mesh);
+        if ((!textured) && (!plain))
+        {
+            return false;
+        }
+        entry.textured = textured ? 1 : 0;
+        entry.vertSize = textured ? textured->vertSize : plain->vertSize;
+        entry.indexSize = textured ? textured->indexSize : plain->indexSize;
+        entry.texCount = meshes[x].textures.size();
+        entry.lodCount = meshes[x].mesh->lods.size();
+        entry.opacity = meshes[x].mesh->opacity;
+        for (int y = 0; (plain) && (y < 3); y++)
+        {
+            entry.color[y] = plain->colordiff[y];
+        }
+        putBytes(contents, &entry, sizeof(entry));
+        for (int y = 0; y < meshes[x].textures.size(); y++)
+        {
+            const Texture &texture = meshes[x].textures[y];
+            GLuint lengths[2] = { (GLuint)texture.type.size(), (GLuint)texture.path.size() };
+            putBytes(contents, lengths, sizeof(lengths));
+            putString(contents, texture.type);
+            putString(contents, texture.path);
+        }
+        if (entry.lodCount > 0)
+        {
+            putBytes(contents, meshes[x].mesh->lods.data(), entry.lodCount * sizeof(MeshLod));
+        }
+        if (textured)
+        {
+            putBytes(contents, textured->vertices, entry.vertSize * sizeof(Vertex));
+            putBytes(contents, textured->indices, entry.indexSize * sizeof(GLuint));
+        }
+        else
+        {
+            putBytes(contents, plain->vertices, entry.vertSize * sizeof(Vertex1));
+            putBytes(contents, plain->indices, entry.indexSize * sizeof(GLuint));
+        }
+    }
+    string dir = path(file).parent_path().string();
+    try
+    {
+        create_directories(path(dir));
+    }
+    catch(exception exc)
+    {
+        cout << "\n\n\tError creating directory " << dir << ":  " << exc.what() << "\n\n";
+        return false;
+    }
+    //! Written to a temporary file and renamed, so a half written file is never mapped.
+    string tempFile = file + ".tmp" + to_string(getpid());
+    FILE *cache = fopen(tempFile.c_str(), "wb");
+    if (!cache)
+    {
+        cout << "\n\n\tError opening file " << tempFile << ".\n\n";
+        return false;
+    }
+    size_t put = fwrite(contents.data(), 1, contents.size(), cache);
+    if ((fclose(cache) != 0) || (put != contents.size()))
+    {
+        cout << "\n\n\tError writing file " << tempFile << ".\n\n";
+        remove(path(tempFile));
+        return false;
+    }
+    try
+    {
+        //! The files of earlier versions of this asset are of no further use.
+        for (directory_iterator it(dir); it != directory_iterator(); ++it)
+        {
+            string name = it->path().filename().string();
+            if ((name.compare(0, prefix.size(), prefix) == 0)
+                && (name.size() == prefix.size() + 20)
+                && (it->path().string() != file))
+            {
+                remove(it->path());
+            }
+        }
+        rename(path(tempFile), path(file));
+    }
+    catch(exception exc)
+    {
+        cout << "\n\n\tError storing file " << file << ":  " << exc.what() << "\n\n";
+        return false;
+    }
+    cout << "\n\n\tSaved mesh cache file " << file << ", " << contents.size() << " bytes.\n\n";
+    return true;
+}
+
+bool MeshCache::load(const string &asset, GLuint64 key, vector<CachedMesh> &meshes,
+shared_ptr<MappedFile> &mapping)
+{
+    string prefix;
+    string file = cacheFile(asset, key, prefix);
+    if (file.empty())
+    {
+        return false;
+    }
+    ResourceView view;
+    view.mapping = make_shared<MappedFile>();
+    if (!view.mapping->open(file))
+    {
+        return false;
+    }
+    view.data = view.mapping->data();
+    view.size = view.mapping->size();
+    if (!readMeshes(file, view, &key, meshes))
+    {
+        return false;
+    }
+    mapping = view.mapping;
+    cout << "\n\n\tMapped mesh cache file " << file << ".\n\n";
+    return true;
+}
+
+bool MeshCache::loadArchived(const string &asset, vector<CachedMesh> &meshes,
+shared_ptr<MappedFile> &mapping)
+{
+    ResourceView view;
+    if ((!ResourceArchive::findMounted(asset, RESOURCE_MESH, view))
+        || (!readMeshes("archived " + asset, view, nullptr, meshes)))
+    {
+        return false;
+    }
+    mapping = view.mapping;
+    return true;
+}
+
+bool MeshCache::readMeshes(const string &file, const ResourceView &view, const GLuint64 *key,
+vector<CachedMesh> &meshes)
+{
+    const unsigned char *data = view.data;
+    size_t size = view.size, offset = sizeof(MeshCacheHeader);
+    MeshCacheHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if ((memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0) 
+        || ((key) && (header.key != *key))
+        || (header.version != MESH_CACHE_VERSION))
+    {
+        cout << "\n\n\tThe mesh cache file " << file << " does not match, it is ignored.\n\n";
+        return false;
+    }
+    /** Every read is checked against what is left before the count
+     *  is scaled, so a damaged file is refused, not followed.
+     */
+    auto take = [&](size_t count, size_t unit) -> const unsigned char *
+    {
+        if (count > (size - offset) / unit)
+        {
+            return nullptr;
+        }
+        const unsigned char *at = data + offset;
+        offset += count * unit;
+        return at;
+    };
+    if (header.meshes > (size - offset) / sizeof(MeshCacheEntry))
+    {
+        cout << "\n\n\tThe mesh cache file " << file << " is cut short, it is ignored.\n\n";
+        return false;
+    }
+    vector<CachedMesh> found(header.meshes);
+    for (int x = 0; x < header.meshes; x++)
+    {
+        const unsigned char *at = take(1, sizeof(MeshCacheEntry));
+        if (!at)
+        {
+            cout << "\n\n\tThe mesh cache file " << file << " is cut short, it is ignored.\n\n";
+            return false;
+        }
+        MeshCacheEntry entry;
+        memcpy(&entry, at, sizeof(entry));
+        CachedMesh &mesh = found[x];
+        mesh.textured = (entry.textured != 0);
+        mesh.vertSize = entry.vertSize;
+        mesh.indexSize = entry.indexSize;
+        mesh.opacity = entry.opacity;
+        mesh.color = vec3(entry.color[0], entry.color[1], entry.color[2]);
+        for (int y = 0; y < entry.texCount; y++)
+        {
+            GLuint lengths[2];
+            const unsigned char *text = take(1, sizeof(lengths));
+            if (!text)
+            {
+                return false;
+            }
+            memcpy(lengths, text, sizeof(lengths));
+            //! The strings are padded to 4 bytes, the length is checked before it is rounded up.
+            const char *type = (lengths[0] <= size - offset) ? (const char *)take(((size_t)lengths[0] + 3) / 4, 4) : nullptr;
+            const char *name = (type && (lengths[1] <= size - offset)) ? (const char *)take(((size_t)lengths[1] + 3) / 4, 4) : nullptr;
+            if ((!type) || (!name))
+            {
+                return false;
+            }
+            Texture texture;
+            texture.id = 0;
+            texture.type.assign(type, lengths[0]);
+            texture.path.assign(name, lengths[1]);
+            mesh.textures.push_back(texture);
+        }
+        const unsigned char *lods = take(entry.lodCount, sizeof(MeshLod));
+        if (!lods)
+        {
+            return false;
+        }
+        mesh.lods.resize(entry.lodCount);
+        if (entry.lodCount > 0)
+        {
+            memcpy(mesh.lods.data(), lods, entry.lodCount * sizeof(MeshLod));
+        }
+        const unsigned char *vertices = take(entry.vertSize, mesh.textured ? sizeof(Vertex) : sizeof(Vertex1));
+        const unsigned char *indices = take(entry.indexSize, sizeof(GLuint));
+        if ((!vertices) || (!indices))
+        {
+            cout << "\n\n\tThe mesh cache file " << file << " is cut short, it is ignored.\n\n";
+            return false;
+        }
+        if (mesh.textured)
+        {
+            mesh.vertices = (const Vertex *)vertices;
+        }
+        else
+        {
+            mesh.plainVertices = (const Vertex1 *)vertices;
+        }
+        mesh.indices = (const GLuint *)indices;
+        //! Cached meshes skip the optimizer, and its check that every index names a vertex.
+        for (int y = 0; y < mesh.indexSize; y++)
+        {
+            if (mesh.indices[y] >= entry.vertSize)
+            {
+                cout << "\n\n\tThe mesh cache file " << file << " has an index past its vertices, it is ignored.\n\n";
+                return false;
+            }
+        }
+        for (const MeshLod &lod : mesh.lods)
+        {
+            if ((lod.firstIndex > (GLuint)mesh.indexSize) || (lod.indexCount > (GLuint)mesh.indexSize - lod.firstIndex))
+            {
+                cout << "\n\n\tThe mesh cache file " << file << " has a bad level of detail, it is ignored.\n\n";
+                return false;
+            }
+        }
+    }
+    meshes = std::move(found);
+    return true;
+}
@@ -0,0 +1,393 @@
+/**********************************************************
+ *   MeshOptimizer:  A class to reorder the vertices and
+ *   triangles of a mesh at load time, so the GPU transforms
+ *   each vertex fewer times, shades fewer hidden pixels and
+ *   reads the vertex buffer in order.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/meshoptimizer.h"
+#include "../include/shader.h"
+#include <cstring>
+#include <unordered_map>
+
+bool MeshOptimizer::enabled = true;
+
+void MeshOptimizer::setEnabled(bool enabled)
+{
+    MeshOptimizer::enabled = enabled;
+}
+
+bool MeshOptimizer::isEnabled()
+{
+    return enabled;
+}
+
+GLuint MeshOptimizer::optimize(unsigned char *vertices, size_t stride, GLuint vertexCount,
+GLuint *indices, GLuint indexCount, MeshOptimizeStats &stats)
+{
+    stats = MeshOptimizeStats();
+    stats.verticesBefore = stats.verticesAfter = vertexCount;
+    stats.triangles = indexCount / 3;
+    stats.missesBefore = stats.missesAfter = cacheMisses(indices, indexCount, vertexCount);
+    if ((indexCount < 3) || (indexCount % 3 != 0) || (stride < 3 * sizeof(float)))
+    {
+        return vertexCount;
+    }
+    for (GLuint x = 0; x < indexCount; x++)
+    {
+        if (indices[x] >= vertexCount)
+        {
+            cout << "\n\n\tMesh index " << indices[x] << " is out of range, the mesh is not optimized.\n\n";
+            return vertexCount;
+        }
+    }
+    vertexCount = mergeVertices(vertices, stride, vertexCount, indices, indexCount);
+    orderForCache(indices, indexCount, vertexCount);
+    stats.overdraw = orderForOverdraw(vertices, stride, vertexCount, indices, indexCount);
+    vertexCount = orderForFetch(vertices, stride, vertexCount, indices, indexCount);
+    stats.verticesAfter = vertexCount;
+    stats.missesAfter = cacheMisses(indices, indexCount, vertexCount);
+    return vertexCount;
+}
+
+GLuint MeshOptimizer::cacheMisses(const GLuint *indices, GLuint indexCount, GLuint vertexCount,
+int cacheSize)
+{
+    //! A FIFO cache, a hit does not move the vertex.
+    vector<GLuint> entered(vertexCount, 0);
+    GLuint misses = 0;
+    for (GLuint x = 0; x < indexCount; x++)
+    {
+        GLuint vertex = indices[x];
+        if ((vertex >= vertexCount) || ((entered[vertex] > 0) && (misses - entered[vertex] < cacheSize)))
+        {
+            continue;
+        }
+        misses++;
+        entered[vertex] = misses;
+    }
+    return misses;
+}
+
+GLuint MeshOptimizer::mergeVertices(unsigned char *vertices, size_t stride, GLuint vertexCount,
+GLuint *indices, GLuint indexCount)
+{
+    unordered_multimap<GLuint64, GLuint> seen;
+    seen.reserve(vertexCount);
+    vector<GLuint> remap(vertexCount);
+    GLuint kept = 0;
+    for (GLuint x = 0; x < vertexCount; x++)
+    {
+        const unsigned char *vertex = vertices + x * stride;
+        GLuint64 hash = Shader::hashBytes(vertex, stride, FNV_OFFSET);
+        auto range = seen.equal_range(hash);
+        GLuint found = ~0u;
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (memcmp(vertices + it->second * stride, vertex, stride) == 0)
+            {
+                found = it->second;
+                break;
+            }
+        }
+        if (found != ~0u)
+        {
+            remap[x] = found;
+            continue;
+        }
+        //! The kept vertices move down, never over one not yet read.
+        if (kept != x)
+        {
+            memcpy(vertices + kept * stride, vertex, stride);
+        }
+        seen.insert(make_pair(hash, kept));
+        remap[x] = kept++;
+    }
+    for (GLuint x = 0; x < indexCount; x++)
+    {
+        indices[x] = remap[indices[x]];
+    }
+    return kept;
+}
+
+float MeshOptimizer::vertexScore(int cachePosition, int remaining)
+{
+    //! The constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+    const float decayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceScale = 2.0f;
+    const float valencePower = 0.5f;
+    if (remaining == 0)
+    {
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+        {
+            //! The vertices of the last triangle, using them again gains little.
+            score = lastTriangleScore;
+        }
+        else
+        {
+            float scale = 1.0f / (VERTEX_SCORE_CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scale, decayPower);
+        }
+    }
+    //! Vertices with few triangles left are finished off first.
+    score += valenceScale * powf((float)remaining, -valencePower);
+    return score;
+}
+
+void MeshOptimizer::orderForCache(GLuint *indices, GLuint indexCount, GLuint vertexCount)
+{
+    GLuint triangles = indexCount / 3;
+    //! The triangles of each vertex, the first remaining[] of them not yet emitted.
+    vector<GLuint> start(vertexCount + 1, 0);
+    for (GLuint x = 0; x < indexCount; x++)
+    {
+        start[indices[x] + 1]++;
+    }
+    for (GLuint x = 0; x < vertexCount; x++)
+    {
+        start[x + 1] += start[x];
+    }
+    vector<GLuint> adjacent(indexCount);
+    vector<int> remaining(vertexCount, 0);
+    for (GLuint x = 0; x < indexCount; x++)
+    {
+        GLuint vertex = indices[x];
+        adjacent[start[vertex] + remaining[vertex]++] = x / 3;
+    }
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> vertexScores(vertexCount);
+    for (GLuint x = 0; x < vertexCount; x++)
+    {
+        vertexScores[x] = vertexScore(-1, remaining[x]);
+    }
+    vector<float> triangleScores(triangles);
+    vector<bool> emitted(triangles, false);
+    int best = -1;
+    float bestScore = -1.0f;
+    for (GLuint x = 0; x < triangles; x++)
+    {
+        triangleScores[x] = vertexScores[indices[x * 3]] + vertexScores[indices[x * 3 + 1]]
+        + vertexScores[indices[x * 3 + 2]];
+        if (triangleScores[x] > bestScore)
+        {
+            bestScore = triangleScores[x];
+            best = x;
+        }
+    }
+    vector<GLuint> order;
+    order.reserve(indexCount);
+    vector<GLuint> cache, next;
+    GLuint cursor = 0;
+    for (GLuint count = 0; count < triangles; count++)
+    {
+        if (best < 0)
+        {
+            //! Nothing in the cache has triangles left, take the next one not emitted.
+            while (emitted[cursor])
+            {
+                cursor++;
+            }
+            best = cursor;
+        }
+        emitted[best] = true;
+        const GLuint *triangle = indices + best * 3;
+        next.clear();
+        for (int y = 0; y < 3; y++)
+        {
+            GLuint vertex = triangle[y];
+            order.push_back(vertex);
+            next.push_back(vertex);
+            //! Take the triangle out of the vertex's remaining list.
+            GLuint *list = adjacent.data() + start[vertex];
+            for (int z = 0; z < remaining[vertex]; z++)
+            {
+                if (list[z] == (GLuint)best)
+                {
+                    list[z] = list[remaining[vertex] - 1];
+                    remaining[vertex]--;
+                    break;
+                }
+            }
+        }
+        for (int y = 0; y < cache.size(); y++)
+        {
+            if ((cache[y] != triangle[0]) && (cache[y] != triangle[1]) && (cache[y] != triangle[2]))
+            {
+                next.push_back(cache[y]);
+            }
+        }
+        cache.swap(next);
+        //! The vertices pushed out of the cache are scored again too.
+        for (int y = 0; y < cache.size(); y++)
+        {
+            GLuint vertex = cache[y];
+            cachePosition[vertex] = (y < VERTEX_SCORE_CACHE_SIZE) ? y : -1;
+            vertexScores[vertex] = vertexScore(cachePosition[vertex], remaining[vertex]);
+        }
+        best = -1;
+        bestScore = -1.0f;
+        for (int y = 0; y < cache.size(); y++)
+        {
+            GLuint vertex = cache[y];
+            for (int z = 0; z < remaining[vertex]; z++)
+            {
+                GLuint other = adjacent[start[vertex] + z];
+                const GLuint *corners = indices + other * 3;
+                triangleScores[other] = vertexScores[corners[0]] + vertexScores[corners[1]]
+                + vertexScores[corners[2]];
+                if (triangleScores[other] > bestScore)
+                {
+                    bestScore = triangleScores[other];
+                    best = other;
+                }
+            }
+        }
+        if (cache.size() > VERTEX_SCORE_CACHE_SIZE)
+        {
+            cache.resize(VERTEX_SCORE_CACHE_SIZE);
+        }
+    }
+    memcpy(indices, order.data(), indexCount * sizeof(GLuint));
+}
+
+bool MeshOptimizer::orderForOverdraw(const unsigned char *vertices, size_t stride, GLuint vertexCount,
+GLuint *indices, GLuint indexCount)
+{
+    GLuint triangles = indexCount / 3;
+    auto position = [&](GLuint vertex) -> vec3
+    {
+        float value[3];
+        memcpy(value, vertices + vertex * stride, sizeof(value));
+        return vec3(value[0], value[1], value[2]);
+    };
+    vec3 center(0.0f);
+    for (GLuint x = 0; x < vertexCount; x++)
+    {
+        center += position(x);
+    }
+    center = center / (float)std::max(vertexCount, 1u);
+    /** The cache order is cut into runs wherever a triangle misses on
+     *  all three vertices, the cache starts over there anyway, so the
+     *  runs can be moved about at little cost to the cache.
+     */
+    vector<GLuint> runs;
+    vector<GLuint> entered(vertexCount, 0);
+    GLuint misses = 0;
+    for (GLuint x = 0; x < triangles; x++)
+    {
+        int missed = 0;
+        for (int y = 0; y < 3; y++)
+        {
+            GLuint vertex = indices[x * 3 + y];
+            if ((entered[vertex] == 0) || (misses - entered[vertex] >= VERTEX_CACHE_SIZE))
+            {
+                misses++;
+                entered[vertex] = misses;
+                missed++;
+            }
+        }
+        if ((missed == 3) || (x == 0))
+        {
+            runs.push_back(x);
+        }
+    }
+    if (runs.size() < 2)
+    {
+        return false;
+    }
+    runs.push_back(triangles);
+    //! Each run is sorted by how far it faces out from the center, outward first.
+    vector<float> keys(runs.size() - 1);
+    for (int x = 0; x < keys.size(); x++)
+    {
+        vec3 normal(0.0f), centroid(0.0f);
+        float area = 0.0f;
+        for (GLuint y = runs[x]; y < runs[x + 1]; y++)
+        {
+            vec3 a = position(indices[y * 3]);
+            vec3 b = position(indices[y * 3 + 1]);
+            vec3 c = position(indices[y * 3 + 2]);
+            vec3 face = cross(b - a, c - a);
+            float size = length(face);
+            normal += face;
+            centroid += (a + b + c) * (size / 3.0f);
+            area += size;
+        }
+        centroid = (area > 0.0f) ? centroid / area : centroid;
+        float span = length(normal);
+        keys[x] = (span > 0.0f) ? dot(centroid - center, normal / span) : 0.0f;
+    }
+    vector<int> order(keys.size());
+    for (int x = 0; x < order.size(); x++)
+    {
+        order[x] = x;
+    }
+    stable_sort(order.begin(), order.end(), [&keys](int a, int b)
+    {
+        return keys[a] > keys[b];
+    });
+    vector<GLuint> sorted;
+    sorted.reserve(indexCount);
+    for (int x = 0; x < order.size(); x++)
+    {
+        sorted.insert(sorted.end(), indices + runs[order[x]] * 3, indices + runs[order[x] + 1] * 3);
+    }
+    GLuint before = cacheMisses(indices, indexCount, vertexCount);
+    GLuint after = cacheMisses(sorted.data(), indexCount, vertexCount);
+    if (after > before * OVERDRAW_THRESHOLD)
+    {
+        return false;
+    }
+    memcpy(indices, sorted.data(), indexCount * sizeof(GLuint));
+    return true;
+}
+
+GLuint MeshOptimizer::orderForFetch(unsigned char *vertices, size_t stride, GLuint vertexCount,
+GLuint *indices, GLuint indexCount)
+{
+    vector<GLuint> remap(vertexCount, ~0u);
+    GLuint used = 0;
+    for (GLuint x = 0; x < indexCount; x++)
+    {
+        if (remap[indices[x]] == ~0u)
+        {
+            remap[indices[x]] = used++;
+        }
+        indices[x] = remap[indices[x]];
+    }
+    //! Vertices no triangle uses are dropped.
+    vector<unsigned char> copy(vertices, vertices + vertexCount * stride);
+    for (GLuint x = 0; x < vertexCount; x++)
+    {
+        if (remap[x] != ~0u)
+        {
+            memcpy(vertices + remap[x] * stride, copy.data() + x * stride, stride);
+        }
+    }
+    return used;
+}
+
+void MeshOptimizer::addStats(MeshOptimizeStats &total, const MeshOptimizeStats &stats)
+{
+    total.verticesBefore += stats.verticesBefore;
+    total.verticesAfter += stats.verticesAfter;
+    total.triangles += stats.triangles;
+    total.missesBefore += stats.missesBefore;
+    total.missesAfter += stats.missesAfter;
+    total.overdraw = (total.overdraw) || (stats.overdraw);
+}
+
+void MeshOptimizer::printStats(const MeshOptimizeStats &stats, const string &name)
+{
+    cout << "\n\n\tOptimized " << name << ":  " << stats.triangles << " triangles, vertices "
+    << stats.verticesBefore << " -> " << stats.verticesAfter << ", ACMR " << stats.acmrBefore()
+    << " -> " << stats.acmrAfter() << (stats.overdraw ? ", ordered for overdraw" : "") << ".\n\n";
+}
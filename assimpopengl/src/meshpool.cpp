@@ -0,0 +1,193 @@
+/**********************************************************
+ *   MeshPool:  A class to hold the vertices and indices of
+ *   many meshes in a few large buffer objects.  Meshes with
+ *   the same vertex layout share one vertex array, and each
+ *   is drawn from its own range of the buffers with a base
+ *   vertex and a first index.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/meshpool.h"
+
+MeshPool::MeshPool(GLsizeiptr blockSize)
+{
+    cout << "\n\n\tCreating MeshPool.\n\n";
+    this->blockSize = blockSize;
+}
+
+MeshPool::~MeshPool()
+{
+    cout << "\n\n\tDestroying MeshPool.\n\n";
+    for (MeshArena &arena : arenas)
+    {
+        glDeleteVertexArrays(1, &arena.vao);
+        glDeleteBuffers(1, &arena.vbo);
+        glDeleteBuffers(1, &arena.ebo);
+    }
+}
+
+bool MeshPool::hasBaseVertex()
+{
+    return ((GLEW_VERSION_3_2) || (GLEW_ARB_draw_elements_base_vertex));
+}
+
+GLsizei MeshPool::vertexSize(int layout)
+{
+    switch (layout)
+    {
+        case LAYOUT_PLAIN:
+            return sizeof(Vertex1);
+        case LAYOUT_PACKED_TEXTURED:
+            return sizeof(PackedVertex);
+        case LAYOUT_PACKED_PLAIN:
+            return sizeof(PackedVertex1);
+        default:
+            return sizeof(Vertex);
+    }
+}
+
+/** Positions at 0, normals at 1, binormals at 2 and texture
+ *  coordinates at 3, as bulletshader.vs reads them.  The packed
+ *  layouts are decoded under PACKED_VERTICES.
+ */
+void MeshPool::vertexAttributes(int layout)
+{
+    GLsizei stride = vertexSize(layout);
+    if ((layout == LAYOUT_PACKED_TEXTURED) || (layout == LAYOUT_PACKED_PLAIN))
+    {
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, Position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, Normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, BiNormal));
+        glEnableVertexAttribArray(2);
+        if (layout == LAYOUT_PACKED_TEXTURED)
+        {
+            glVertexAttribPointer(3, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, TexCoords));
+            glEnableVertexAttribArray(3);
+        }
+        return;
+    }
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    if (layout == LAYOUT_TEXTURED)
+    {
+        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(9 * sizeof(float)));
+        glEnableVertexAttribArray(3);
+    }
+}
+
+//! Only the newest arena of a layout is filled, the older ones are full.
+int MeshPool::findArena(int layout, GLsizeiptr vertexBytes, GLsizeiptr indexCount)
+{
+    for (int x = arenas.size() - 1; x >= 0; x--)
+    {
+        if (arenas[x].layout != layout)
+        {
+            continue;
+        }
+        if ((arenas[x].vertexUsed + vertexBytes <= arenas[x].vertexCapacity)
+            && (arenas[x].indexUsed + indexCount <= arenas[x].indexCapacity))
+        {
+            return x;
+        }
+        break;
+    }
+    MeshArena arena;
+    arena.layout = layout;
+    //! A mesh larger than a block gets buffers of its own size.
+    arena.vertexCapacity = std::max(blockSize, vertexBytes);
+    arena.indexCapacity = std::max(blockSize / (GLsizeiptr)sizeof(GLuint), indexCount);
+    glGenVertexArrays(1, &arena.vao);
+    glGenBuffers(1, &arena.vbo);
+    glGenBuffers(1, &arena.ebo);
+    glBindVertexArray(arena.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, arena.vbo);
+    glBufferData(GL_ARRAY_BUFFER, arena.vertexCapacity, nullptr, GL_STATIC_DRAW);
+    vertexAttributes(layout);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, arena.indexCapacity * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    arenas.push_back(arena);
+    if (debug1)
+    {
+        cout << "\n\n\tStarted mesh buffers " << arenas.size() - 1 << " for layout "
+        << layout << ", " << arena.vertexCapacity << " vertex bytes.\n\n";
+    }
+    return arenas.size() - 1;
+}
+
+MeshRange MeshPool::allocate(int layout, const GLvoid *vertices, GLsizei vertexCount,
+const GLuint *indices, GLsizei indexCount)
+{
+    MeshRange range;
+    GLsizeiptr vertexBytes = (GLsizeiptr)vertexCount * vertexSize(layout);
+    range.arena = findArena(layout, vertexBytes, indexCount);
+    MeshArena &arena = arenas[range.arena];
+    range.vao = arena.vao;
+    range.baseVertex = arena.vertexUsed / vertexSize(layout);
+    range.firstIndex = arena.indexUsed;
+    glBindBuffer(GL_ARRAY_BUFFER, arena.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, arena.vertexUsed, vertexBytes, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    //! The element buffer is bound through the vertex array, it belongs to it.
+    glBindVertexArray(arena.vao);
+    if ((hasBaseVertex()) || (range.baseVertex == 0))
+    {
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, arena.indexUsed * sizeof(GLuint),
+        indexCount * sizeof(GLuint), indices);
+    }
+    else
+    {
+        vector<GLuint> rebased(indices, indices + indexCount);
+        for (GLuint &index : rebased)
+        {
+            index += range.baseVertex;
+        }
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, arena.indexUsed * sizeof(GLuint),
+        indexCount * sizeof(GLuint), rebased.data());
+        range.baseVertex = 0;
+    }
+    glBindVertexArray(0);
+    arena.vertexUsed += vertexBytes;
+    arena.indexUsed += indexCount;
+    arena.meshes++;
+    return range;
+}
+
+GLuint MeshPool::createVertexArray(int arena)
+{
+    GLuint vao = 0;
+    if ((arena < 0) || (arena >= arenas.size()))
+    {
+        return vao;
+    }
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, arenas[arena].vbo);
+    vertexAttributes(arenas[arena].layout);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arenas[arena].ebo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vao;
+}
+
+void MeshPool::printStats()
+{
+    cout << "\n\n\tMesh Pool:  " << arenas.size() << " buffer pairs"
+    << (hasBaseVertex() ? ", drawn with a base vertex." : ", indices rebased.");
+    for (int x = 0; x < arenas.size(); x++)
+    {
+        cout << "\n\tLayout " << arenas[x].layout << ":  " << arenas[x].meshes << " meshes, "
+        << arenas[x].vertexUsed << " of " << arenas[x].vertexCapacity << " vertex bytes, "
+        << arenas[x].indexUsed << " of " << arenas[x].indexCapacity << " indices.";
+    }
+    cout << "\n\n";
+}
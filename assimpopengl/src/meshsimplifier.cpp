@@ -0,0 +1,190 @@
+/**********************************************************
+ *   MeshSimplifier:  A class to build coarser levels of
+ *   detail of a mesh at load time, by vertex clustering, so
+ *   the objects far from the camera are drawn with fewer
+ *   triangles.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/meshsimplifier.h"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <set>
+#include <unordered_map>
+
+bool MeshSimplifier::enabled = true;
+
+void MeshSimplifier::setEnabled(bool enabled)
+{
+    MeshSimplifier::enabled = enabled;
+}
+
+bool MeshSimplifier::isEnabled()
+{
+    return enabled;
+}
+
+GLuint MeshSimplifier::normalClass(const float *normal)
+{
+    int axis = 0;
+    for (int y = 1; y < 3; y++)
+    {
+        if (fabs(normal[y]) > fabs(normal[axis]))
+        {
+            axis = y;
+        }
+    }
+    return axis * 2 + ((normal[axis] < 0.0f) ? 1 : 0);
+}
+
+void MeshSimplifier::buildLods(const unsigned char *vertices, size_t stride, GLuint vertexCount,
+vector<GLuint> &indices, vector<MeshLod> &lods)
+{
+    lods.clear();
+    MeshLod full;
+    full.indexCount = indices.size();
+    lods.push_back(full);
+    if ((!enabled) || (full.indexCount < 3) || (full.indexCount % 3 != 0) || (stride < 6 * sizeof(float)))
+    {
+        return;
+    }
+    for (GLuint x = 0; x < full.indexCount; x++)
+    {
+        if (indices[x] >= vertexCount)
+        {
+            return;
+        }
+    }
+    float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (GLuint x = 0; x < vertexCount; x++)
+    {
+        const float *position = (const float *)(vertices + x * stride);
+        for (int y = 0; y < 3; y++)
+        {
+            lower[y] = std::min(lower[y], position[y]);
+            upper[y] = std::max(upper[y], position[y]);
+        }
+    }
+    float extent = std::max(upper[0] - lower[0], std::max(upper[1] - lower[1], upper[2] - lower[2]));
+    if (extent <= 0.0f)
+    {
+        return;
+    }
+    GLuint previous = full.indexCount;
+    vector<GLuint> clustered;
+    for (int level = 1; level < MESH_LOD_LEVELS; level++)
+    {
+        float cellSize = extent / (float)(MESH_LOD_DIVISIONS >> (level - 1));
+        //! Every level is clustered from the full mesh, so the errors do not add up.
+        cluster(vertices, stride, vertexCount, indices.data(), full.indexCount, lower, cellSize, clustered);
+        //! A grid too fine to remove much is passed over, a coarser one may still.
+        if ((clustered.empty()) || (clustered.size() > previous * MESH_LOD_REDUCTION))
+        {
+            continue;
+        }
+        MeshLod lod;
+        lod.firstIndex = indices.size();
+        lod.indexCount = clustered.size();
+        lod.error = cellSize;
+        indices.insert(indices.end(), clustered.begin(), clustered.end());
+        lods.push_back(lod);
+        previous = lod.indexCount;
+    }
+}
+
+void MeshSimplifier::cluster(const unsigned char *vertices, size_t stride, GLuint vertexCount,
+const GLuint *indices, GLuint indexCount, const float *origin, float cellSize,
+vector<GLuint> &clustered)
+{
+    clustered.clear();
+    unordered_map<GLuint64, GLuint> cells;
+    vector<GLuint> cellOf(vertexCount);
+    vector<float> sums;
+    vector<GLuint> counts;
+    for (GLuint x = 0; x < vertexCount; x++)
+    {
+        const float *position = (const float *)(vertices + x * stride);
+        //! Twenty bits a coordinate and the normal's direction above them.
+        GLuint64 key = normalClass(position + 3);
+        for (int y = 2; y >= 0; y--)
+        {
+            GLuint64 cell = (GLuint64)std::max((position[y] - origin[y]) / cellSize, 0.0f);
+            key = (key << 20) | std::min(cell, (GLuint64)0xFFFFF);
+        }
+        auto found = cells.find(key);
+        if (found == cells.end())
+        {
+            found = cells.insert(make_pair(key, (GLuint)counts.size())).first;
+            counts.push_back(0);
+            sums.insert(sums.end(), 3, 0.0f);
+        }
+        GLuint cell = found->second;
+        cellOf[x] = cell;
+        counts[cell]++;
+        for (int y = 0; y < 3; y++)
+        {
+            sums[cell * 3 + y] += position[y];
+        }
+    }
+    //! The vertex nearest the middle of its cell stands for the cell.
+    vector<GLuint> chosen(counts.size(), 0);
+    vector<float> nearest(counts.size(), FLT_MAX);
+    for (GLuint x = 0; x < vertexCount; x++)
+    {
+        const float *position = (const float *)(vertices + x * stride);
+        GLuint cell = cellOf[x];
+        float length = 0.0f;
+        for (int y = 0; y < 3; y++)
+        {
+            float delta = position[y] - sums[cell * 3 + y] / (float)counts[cell];
+            length += delta * delta;
+        }
+        if (length < nearest[cell])
+        {
+            nearest[cell] = length;
+            chosen[cell] = x;
+        }
+    }
+    //! Triangles that collapse, or repeat one already kept, are dropped.
+    set<array<GLuint, 3>> kept;
+    for (GLuint x = 0; x + 2 < indexCount; x += 3)
+    {
+        array<GLuint, 3> triangle;
+        for (int y = 0; y < 3; y++)
+        {
+            triangle[y] = chosen[cellOf[indices[x + y]]];
+        }
+        if ((triangle[0] == triangle[1]) || (triangle[1] == triangle[2]) || (triangle[0] == triangle[2]))
+        {
+            continue;
+        }
+        //! Rotated to start at its smallest index, the winding is kept.
+        while ((triangle[0] > triangle[1]) || (triangle[0] > triangle[2]))
+        {
+            std::rotate(triangle.begin(), triangle.begin() + 1, triangle.end());
+        }
+        if (kept.insert(triangle).second)
+        {
+            clustered.insert(clustered.end(), triangle.begin(), triangle.end());
+        }
+    }
+}
+
+//! The levels are in order of growing error, the last one within the limit is taken.
+int MeshSimplifier::selectLod(const vector<MeshLod> &lods, float pixelsPerUnit)
+{
+    int level = 0;
+    for (int x = 1; x < lods.size(); x++)
+    {
+        if (lods[x].error * pixelsPerUnit > LOD_ERROR_PIXELS)
+        {
+            break;
+        }
+        level = x;
+    }
+    return level;
+}
@@ -8,6 +8,7 @@
  *   March 2020 San Diego, California USA
  * ********************************************************/
 #include "../include/meshtex.h"
+#include <algorithm>
 
 MeshTex::MeshTex()
 {
@@ -19,9 +20,7 @@ MeshTex::~MeshTex()
 {
     cout << "\n\n\tDestroying MeshTex.\n\n";
     // Properly de-allocate all resources once they've outlived their purpose
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    freeMesh(VAO, VBO, EBO);
 }
 // Pass along data from the model class to be drawn here.
 void MeshTex::setData(Vertex *vertices, GLuint *indices, vector<Texture>textures, int vertSize, int indexSize, int texSize)
@@ -32,7 +31,10 @@ void MeshTex::setData(Vertex *vertices, GLuint *indices, vector<Texture>textures
     this->vertSize = vertSize;
     this->indexSize = indexSize;
     this->texSize = texSize;
-    setupMesh();
+    if (!deferSetup)
+    {
+        setupMesh();
+    }
     if (debug1)
     {
         dumpData();
@@ -71,45 +73,42 @@ void MeshTex::dumpData()
 //! Allocate the vertex array and index buffer.
 void MeshTex::setupMesh()
 {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertSize * sizeof(Vertex), vertices, GL_STATIC_DRAW);  
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize * sizeof(GLuint), indices, GL_STATIC_DRAW);
-    
-    // Vertex Positions
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-    glEnableVertexAttribArray(0);   
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);   
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex1), (GLvoid*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2); 
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(9 * sizeof(float)));
-    glEnableVertexAttribArray(3); 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    int layout = LAYOUT_TEXTURED;
+    const GLvoid *data = vertices;
+    vector<PackedVertex> packedVertices;
+    if (packed)
+    {
+        //! Only the GPU copy is packed, the float vertices stay as loaded.
+        packBounds(vertices[0].Position, sizeof(Vertex) / sizeof(float), vertSize, 9);
+        packedVertices.resize(vertSize);
+        for (int x = 0; x < vertSize; x++)
+        {
+            packPosition(vertices[x].Position, packedVertices[x].Position);
+            packDirection(vertices[x].Normal, packedVertices[x].Normal);
+            packDirection(vertices[x].BiNormal, packedVertices[x].BiNormal);
+            packTexCoords(vertices[x].TexCoords, packedVertices[x].TexCoords);
+        }
+        layout = LAYOUT_PACKED_TEXTURED;
+        data = packedVertices.data();
+    }
+    uploadMesh(layout, data, vertSize, indices, indexSize, VAO, VBO, EBO);
 }  
 
-//! Draw the object.
-void MeshTex::Draw(Shader *shader, glm::mat4 view, glm::mat4 projection, glm::mat4 model, vector<PointLight>lights, vector<SpotLight>spotLights, vec3 viewPos, int startIndex, bool diffOnly) 
+//! The uniforms for this mesh, the textures are already bound.
+void MeshTex::setUniforms(Shader *shader, const glm::mat4 *model, int startIndex)
 {
-    glBindVertexArray(VAO);
     bool difftrigger = true;
     bool spectrigger = true;
     bool heighttrigger = true;
-    shader->Use();
-    shader->setBool("diffOnly", diffOnly);
-    //! Bind appropriate textures
-    //! Here we allow for the three types of textures: Diffuse, specular and binormal or bumpmap.
-    for( int x = 0; x < textures.size(); x++)
+    /** Here we allow for the three types of textures: Diffuse, specular and binormal or bumpmap.
+     *  Which of them the shader samples was fixed when its variant was compiled,
+     *  see getFeatures(), only the texture units are passed here.  A sampler
+     *  is only pointed at a unit fillItem() binds, the units past them may
+     *  hold the frame wide integer textures.
+     */
+    int bound = boundTextures(startIndex);
+    for( int x = 0; x < bound; x++)
     {
-        glActiveTexture(GL_TEXTURE0  + startIndex + x); // Active proper texture unit before binding
-        glBindTexture(GL_TEXTURE_2D, textures[x].id);
         //! Texture present.
         if (debug1)
         {
@@ -118,72 +117,113 @@ void MeshTex::Draw(Shader *shader, glm::mat4 view, glm::mat4 projection, glm::ma
         }
         if ((textures[x].type == "texture_diffuse") && (difftrigger))
         {
-            shader->setBool("isDiffuse", true);
             shader->setInt("texture_diffuse1", startIndex + x);
             difftrigger = false;
         }
         else if ((textures[x].type == "texture_specular") && (spectrigger))
         {
-            shader->setBool("isSpecular", true);
             shader->setInt("texture_specular1", startIndex + x);
             spectrigger = false;
         }
         else if ((textures[x].type == "texture_height") && (heighttrigger))
         {
-            shader->setBool("isBinormal", true);
             shader->setInt("texture_binormal1", startIndex + x);
-            spectrigger = false;
+            heighttrigger = false;
         }
     }
-    if (difftrigger)
+    shader->setFloat("shininess", 10.0f);
+    shader->setFloat("opacity", opacity);
+    if (model)
     {
-       shader->setBool("isDiffuse", false);
+        shader->setBool("instanced", false);
+        shader->setMat4("model", *model);
     }
-    if (spectrigger)
+    else
     {
-       shader->setBool("isSpecular", false);
+        shader->setBool("instanced", true);
     }
-    if (heighttrigger)
+    shader->setVec3("colordiff", vec3(1.0f, 1.0f, 1.0f));
+    if (packed)
     {
-       shader->setBool("isBinormal", false);
+        setPackedUniforms(shader);
     }
-    shader->setFloat("shininess", 10.0f);
-    shader->setVec3("viewPos", viewPos);
-    shader->setFloat("opacity", opacity);
-    shader->setMat4("view", view);
-    shader->setMat4("projection", projection);
-    shader->setMat4("model", model);
-    shader->setVec3("colordiff", vec3(1.0f, 1.0f, 1.0f));
-    for (int x = 0; x < lights.size(); x++)
-    {   
-        stringstream ss;
-        ss << x;
-        shader->setVec3("pointLights[" + ss.str() + "].position", lights[x].position);
-        shader->setVec3("pointLights[" + ss.str() + "].ambient", lights[x].ambient);
-        shader->setVec3("pointLights[" + ss.str() + "].diffuse", lights[x].diffuse);
-        shader->setVec3("pointLights[" + ss.str() + "].specular", lights[x].specular);
-        shader->setFloat("pointLights[" + ss.str() + "].constant", lights[x].constant);
-        shader->setFloat("pointLights[" + ss.str() + "].linear", lights[x].linear);
-        shader->setFloat("pointLights[" + ss.str() + "].quadratic", lights[x].quadratic);
+}
+
+//! The vertex array, textures and index count for the render queue.
+void MeshTex::fillItem(RenderItem &item, int startIndex, int lod)
+{
+    item.vao = VAO;
+    item.texCount = boundTextures(startIndex);
+    for (int x = 0; x < item.texCount; x++)
+    {
+        TextureBinding &tex = item.textures[x];
+        tex.target = GL_TEXTURE_2D;
+        tex.id = textures[x].id;
+        tex.unit = startIndex + x;
     }
-    for (int x = 0; x < spotLights.size(); x++)
-    {   
-        stringstream ss;
-        ss << x;
-        shader->setVec3("spotLights[" + ss.str() + "].position", spotLights[x].position);
-        shader->setVec3("spotLights[" + ss.str() + "].direction", spotLights[x].direction);
-        shader->setFloat("spotLights[" + ss.str() + "].cutOff", spotLights[x].cutOff);
-        shader->setFloat("spotLights[" + ss.str() + "].outerCutOff", spotLights[x].outerCutOff);
-        shader->setVec3("spotLights[" + ss.str() + "].ambient", spotLights[x].ambient);
-        shader->setVec3("spotLights[" + ss.str() + "].diffuse", spotLights[x].diffuse);
-        shader->setVec3("spotLights[" + ss.str() + "].specular", spotLights[x].specular);
-        shader->setFloat("spotLights[" + ss.str() + "].constant", spotLights[x].constant);
-        shader->setFloat("spotLights[" + ss.str() + "].linear", spotLights[x].linear);
-        shader->setFloat("spotLights[" + ss.str() + "].quadratic", spotLights[x].quadratic);
+    item.mesh = this;
+    item.startIndex = startIndex;
+    item.mode = GL_TRIANGLES;
+    lodRange(lod, indexSize, item.first, item.count);
+    item.baseVertex = range.baseVertex;
+    item.indexed = true;
+}
+
+//! The units past QUEUE_TEXTURE_UNITS belong to the frame wide textures.
+int MeshTex::boundTextures(int startIndex)
+{
+    int count = std::min((int)textures.size(), MAX_ITEM_TEXTURES);
+    return std::max(0, std::min(count, QUEUE_TEXTURE_UNITS - startIndex));
+}
+
+void MeshTex::setTextureId(int index, GLuint id)
+{
+    if ((index >= 0) && (index < textures.size()))
+    {
+        textures[index].id = id;
+    }
+}
+
+//! The same values setUniforms() passes.
+void MeshTex::fillDrawData(DrawData &data)
+{
+    Mesh::fillDrawData(data);
+    data.color = vec4(vec3(1.0f, 1.0f, 1.0f), opacity);
+    data.positionOffset.w = 10.0f;
+}
+
+//! A pooled mesh shares its vertex array, the instanced draws bring their own.
+void MeshTex::setInstanceBuffer(GLuint buffer, GLintptr offset)
+{
+    if (!pool)
+    {
+        instanceAttributes(VAO, buffer, offset);
     }
-    // Draw mesh
-    glDrawElements(GL_TRIANGLES, indexSize, GL_UNSIGNED_INT, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindVertexArray(0);
 }
 
+//! The first texture of each type is the one sampled, as in setUniforms(), of those an item can bind.
+GLuint MeshTex::getFeatures(bool diffOnly)
+{
+    GLuint features = diffOnly ? FEATURE_DIFF_ONLY : 0;
+    int bound = boundTextures(0);
+    for (int x = 0; x < bound; x++)
+    {
+        if (textures[x].type == "texture_diffuse")
+        {
+            features |= FEATURE_DIFFUSE_MAP;
+        }
+        else if (textures[x].type == "texture_specular")
+        {
+            features |= FEATURE_SPECULAR_MAP;
+        }
+        else if (textures[x].type == "texture_height")
+        {
+            features |= FEATURE_NORMAL_MAP;
+        }
+    }
+    if (packed)
+    {
+        features |= FEATURE_PACKED_VERTICES;
+    }
+    return features;
+}
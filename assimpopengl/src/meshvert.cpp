@@ -20,9 +20,7 @@ MeshVert::~MeshVert()
 {
     cout << "\n\n\tDestroying MeshVert.\n\n";
     // Properly de-allocate all resources once they've outlived their purpose
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    freeMesh(VAO, VBO, EBO);
 }
 
 //!  Pass along data to be displayed from the Model class.
@@ -34,7 +32,10 @@ void MeshVert::setData(Vertex1 *vertices, GLuint *indices, vec3 color, int vertS
     this->vertSize = vertSize;
     this->indexSize = indexSize;
     
-    setupMesh();
+    if (!deferSetup)
+    {
+        setupMesh();
+    }
     //dumpData();
 }
 
@@ -61,74 +62,85 @@ void MeshVert::dumpData()
 //! Allocate array and buffers.
 void MeshVert::setupMesh()
 {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertSize * sizeof(Vertex1), vertices, GL_STATIC_DRAW);  
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize * sizeof(GLuint), indices, GL_STATIC_DRAW);
-    
-    // Vertex Positions
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex1), (GLvoid*)0);
-    glEnableVertexAttribArray(0);   
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex1), (GLvoid*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1); 
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex1), (GLvoid*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2); 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    int layout = LAYOUT_PLAIN;
+    const GLvoid *data = vertices;
+    vector<PackedVertex1> packedVertices;
+    if (packed)
+    {
+        packBounds(vertices[0].Position, sizeof(Vertex1) / sizeof(float), vertSize);
+        packedVertices.resize(vertSize);
+        for (int x = 0; x < vertSize; x++)
+        {
+            packPosition(vertices[x].Position, packedVertices[x].Position);
+            packDirection(vertices[x].Normal, packedVertices[x].Normal);
+            packDirection(vertices[x].BiNormal, packedVertices[x].BiNormal);
+        }
+        layout = LAYOUT_PACKED_PLAIN;
+        data = packedVertices.data();
+    }
+    uploadMesh(layout, data, vertSize, indices, indexSize, VAO, VBO, EBO);
 }  
 
-//! Draw object.
-void MeshVert::Draw(Shader *shader, glm::mat4 view, glm::mat4 projection, glm::mat4 model, vector<PointLight>lights, vector<SpotLight>spotLights, vec3 viewPos, int startIndex) 
+//! The uniforms for this mesh.
+void MeshVert::setUniforms(Shader *shader, const glm::mat4 *model, int startIndex)
 {
-    shader->Use();
-    shader->setBool("diffOnly", false);
-    shader->setMat4("view", view);
-    shader->setMat4("projection", projection);
-    shader->setMat4("model", model);
-    shader->setVec3("viewPos", viewPos);
-    //! No texture present.
-    shader->setBool("isDiffuse1", false);
+    if (model)
+    {
+        shader->setBool("instanced", false);
+        shader->setMat4("model", *model);
+    }
+    else
+    {
+        shader->setBool("instanced", true);
+    }
+    //! No texture present, see getFeatures().
     shader->setFloat("shininess", 1.0f);
     shader->setVec3("colordiff", colordiff);
     shader->setFloat("opacity", opacity);
-    for (int x = 0; x < lights.size(); x++)
-    {   
-        stringstream ss;
-        ss << x;
-        shader->setVec3("pointLights[" + ss.str() + "].position", lights[x].position);
-        shader->setVec3("pointLights[" + ss.str() + "].ambient", lights[x].ambient);
-        shader->setVec3("pointLights[" + ss.str() + "].diffuse", lights[x].diffuse);
-        shader->setVec3("pointLights[" + ss.str() + "].specular", lights[x].specular);
-        shader->setFloat("pointLights[" + ss.str() + "].constant", lights[x].constant);
-        shader->setFloat("pointLights[" + ss.str() + "].linear", lights[x].linear);
-        shader->setFloat("pointLights[" + ss.str() + "].quadratic", lights[x].quadratic);
+    if (packed)
+    {
+        setPackedUniforms(shader);
     }
-    for (int x = 0; x < spotLights.size(); x++)
-    {   
-        stringstream ss;
-        ss << x;
-        shader->setVec3("spotLights[" + ss.str() + "].position", spotLights[x].position);
-        shader->setVec3("spotLights[" + ss.str() + "].direction", spotLights[x].direction);
-        shader->setFloat("spotLights[" + ss.str() + "].cutOff", spotLights[x].cutOff);
-        shader->setFloat("spotLights[" + ss.str() + "].outerCutOff", spotLights[x].outerCutOff);
-        shader->setVec3("spotLights[" + ss.str() + "].ambient", spotLights[x].ambient);
-        shader->setVec3("spotLights[" + ss.str() + "].diffuse", spotLights[x].diffuse);
-        shader->setVec3("spotLights[" + ss.str() + "].specular", spotLights[x].specular);
-        shader->setFloat("spotLights[" + ss.str() + "].constant", spotLights[x].constant);
-        shader->setFloat("spotLights[" + ss.str() + "].linear", spotLights[x].linear);
-        shader->setFloat("spotLights[" + ss.str() + "].quadratic", spotLights[x].quadratic);
+    if (debug1)
+    {
+        cout << "\n\n\tOpacity:  " << opacity << "  Color Vector:  " 
+        << colordiff.x << ", " << colordiff.y << ", " 
+        << colordiff.z << "\n\n";
     }
-    cout << "\n\n\tOpacity:  " << opacity << "  Color Vector:  " 
-    << colordiff.x << ", " << colordiff.y << ", " 
-    << colordiff.z << "\n\n";
-    // Draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indexSize, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+}
+
+//! The vertex array and index count for the render queue.
+void MeshVert::fillItem(RenderItem &item, int startIndex, int lod)
+{
+    item.vao = VAO;
+    item.texCount = 0;
+    item.mesh = this;
+    item.startIndex = startIndex;
+    item.mode = GL_TRIANGLES;
+    lodRange(lod, indexSize, item.first, item.count);
+    item.baseVertex = range.baseVertex;
+    item.indexed = true;
+}
+
+//! The same values setUniforms() passes.
+void MeshVert::fillDrawData(DrawData &data)
+{
+    Mesh::fillDrawData(data);
+    data.color = vec4(colordiff, opacity);
+    data.positionOffset.w = 1.0f;
+}
+
+//! A pooled mesh shares its vertex array, the instanced draws bring their own.
+void MeshVert::setInstanceBuffer(GLuint buffer, GLintptr offset)
+{
+    if (!pool)
+    {
+        instanceAttributes(VAO, buffer, offset);
+    }
+}
+
+//! No textures, and the specular light is always used.
+GLuint MeshVert::getFeatures(bool diffOnly)
+{
+    return packed ? FEATURE_PACKED_VERTICES : 0;
 }
@@ -6,32 +6,88 @@
  *   March 2020 San Diego, California USA
  * ********************************************************/
 #include "../include/model.h"
-//! Load each asset one-by-one.
-Model::Model(vector<ModelInfo> modelinfo)
+#include <algorithm>
+
+//! The slots the shaders sample, in the order the textures are bound.
+static const MaterialSlot materialSlots[] = {
+    {aiTextureType_DIFFUSE, "texture_diffuse", FEATURE_DIFFUSE_MAP},
+    {aiTextureType_SPECULAR, "texture_specular", FEATURE_SPECULAR_MAP},
+    {aiTextureType_HEIGHT, "texture_height", FEATURE_NORMAL_MAP}
+};
+
+//! True if the textures bound under this name are in the maps asked for.
+static bool sampledSlot(const string &name, GLuint maps)
 {
-    cout << "\n\n\tCreating Model.\n\n";
-    glewExperimental=true;
-    GLenum err=glewInit();
-    if(err!=GLEW_OK)
+    for (const MaterialSlot &slot : materialSlots)
     {
-        //Problem: glewInit failed, something is seriously wrong.
-        cout<<"\n\n\tThe function glewInit failed, aborting."<<endl;
-        exit(1);
+        if (name == slot.name)
+        {
+            return ((maps & slot.feature) != 0);
+        }
     }
-    else
+    return false;
+}
+
+//! Load each asset one-by-one.
+Model::Model(vector<ModelInfo> modelinfo, TextureStreamer *streamer, GLuint maps, MeshPool *pool, bool deferred)
+{
+    cout << "\n\n\tCreating Model.\n\n";
+    this->streamer = streamer;
+    this->maps = maps;
+    this->deferred = deferred;
+    //! A deferred model is built off the context thread, which has initialized glew.
+    if (!deferred)
     {
-        cout << "\n\n\tInitialized glew.\n";
+        glewExperimental=true;
+        GLenum err=glewInit();
+        if(err!=GLEW_OK)
+        {
+            //Problem: glewInit failed, something is seriously wrong.
+            cout<<"\n\n\tThe function glewInit failed, aborting."<<endl;
+            exit(1);
+        }
+        else
+        {
+            cout << "\n\n\tInitialized glew.\n";
+        }
+        cout << "\n\n\tUsing GLEW Version: " << glewGetString(GLEW_VERSION) << "\n\n"; 
     }
-    cout << "\n\n\tUsing GLEW Version: " << glewGetString(GLEW_VERSION) << "\n\n"; 
+    //! Without a pool from the caller the model keeps its meshes in one of its own.
+    ownPool = (pool == nullptr);
+    this->pool = ownPool ? new MeshPool() : pool;
     for (unsigned int x = 0; x < modelinfo.size(); x++)
     {
+        //! Objects from the same file share one set of meshes.
+        int group = -1;
+        for (int y = 0; y < groups.size(); y++)
+        {
+            if (groups[y].path == modelinfo[x].path)
+            {
+                group = y;
+                break;
+            }
+        }
+        if (group >= 0)
+        {
+            cout << "\n\n\tSharing Model:  " << modelinfo[x].path << " Model Index:  " << x << ".\n\n";
+            groups[group].members.push_back(x);
+            modelinfo[x].meshes = groups[group].meshes;
+            groupOf.push_back(group);
+            continue;
+        }
         texcount = vertcount = 0;
         cout << "\n\n\tLoading Model:  " << modelinfo[x].path << " Model Index:  " << x << ".\n\n";
         loadModel(modelinfo[x].path);
+        InstanceGroup item;
+        item.path = modelinfo[x].path;
+        item.meshes = meshes;
+        item.members.push_back(x);
+        groups.push_back(item);
+        groupOf.push_back(groups.size() - 1);
         modelinfo[x].meshes = meshes;
+        limit = meshes.size();
         meshes.clear();
         textures.clear();
-        limit = meshes.size();
         if (debug1)
         {
             cout << "\n\n\tProcessed " << texcount << " textured"
@@ -40,86 +96,361 @@ Model::Model(vector<ModelInfo> modelinfo)
         }
     }
     this->modelinfo = modelinfo;
+    for (int x = 0; x < this->modelinfo.size(); x++)
+    {
+        this->modelinfo[x].scale = matrixScale(this->modelinfo[x].model);
+    }
+    drawOrder.resize(modelinfo.size());
+    for (int x = 0; x < drawOrder.size(); x++)
+    {
+        drawOrder[x] = x;
+    }
+    for (int y = 0; y < groups.size(); y++)
+    {
+        groups[y].transparent = isTransparent(groups[y].members[0]);
+    }
+    //! The opaque objects keep the order they were given in, the transparent ones follow them.
+    firstTransparent = std::stable_partition(drawOrder.begin(), drawOrder.end(),
+    [this](int object) { return !isTransparent(object); }) - drawOrder.begin();
+    for (int y = 0; y < groups.size(); y++)
+    {
+        meshTotal += groups[y].meshes.size();
+    }
+    if (!deferred)
+    {
+        finishLoading();
+    }
+}
+
+//! One mesh at a time, its textures first, so the budget is kept to within a mesh.
+bool Model::finishLoading(double budgetMs)
+{
+    if (loaded)
+    {
+        return true;
+    }
+    //! From here on the work is done on the context thread.
+    deferred = false;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    while (uploadGroup < groups.size())
+    {
+        if (uploadMesh >= groups[uploadGroup].meshes.size())
+        {
+            uploadGroup++;
+            uploadMesh = 0;
+            continue;
+        }
+        MeshInfo &info = groups[uploadGroup].meshes[uploadMesh];
+        for (int x = 0; x < info.textures.size(); x++)
+        {
+            if (info.textures[x].id == MODEL_PENDING_TEXTURE)
+            {
+                info.textures[x].id = TextureFromFile(info.textures[x].path);
+                info.mesh->setTextureId(x, info.textures[x].id);
+            }
+        }
+        if (info.mesh->deferSetup)
+        {
+            info.mesh->deferSetup = false;
+            info.mesh->setupMesh();
+        }
+        uploadMesh++;
+        uploaded++;
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if ((budgetMs > 0.0) && (elapsed >= budgetMs))
+        {
+            return false;
+        }
+    }
+    decoded.clear();
+    //! The objects hold copies of their group's mesh list, with the new texture ids.
+    for (int x = 0; x < modelinfo.size(); x++)
+    {
+        modelinfo[x].meshes = groups[groupOf[x]].meshes;
+    }
+    //! The matrices of each file used more than once go through the ring.
+    for (int y = 0; y < groups.size(); y++)
+    {
+        if (groups[y].members.size() > 1)
+        {
+            groups[y].matrices.resize(groups[y].members.size());
+            cout << "\n\n\tDrawing " << groups[y].members.size() << " instances of " 
+            << groups[y].path << ".\n\n";
+            //! The instance matrices go on vertex arrays of the group's own.
+            for (int x = 0; x < groups[y].meshes.size(); x++)
+            {
+                int arena = groups[y].meshes[x].mesh->getArena();
+                if ((arena >= 0) && (groups[y].arrays.find(arena) == groups[y].arrays.end()))
+                {
+                    groups[y].arrays[arena] = this->pool->createVertexArray(arena);
+                }
+            }
+        }
+    }
+    this->pool->printStats();
+    frameRing = new RingBuffer();
+    TextureRegistry::printStats();
+    loaded = true;
+    return true;
+}
+
+float Model::uploadProgress()
+{
+    if (meshTotal == 0)
+    {
+        return loaded ? 1.0f : 0.0f;
+    }
+    return (float) uploaded / (float) meshTotal;
+}
+
+bool Model::isLoaded()
+{
+    return loaded;
 }
 
 Model::~Model()
 {
     cout << "\n\n\tDestroying Model.\n\n";
-    for (int y = 0; y < modelinfo.size(); y++)
+    //! The meshes belong to the groups, the objects only share them.
+    for (int y = 0; y < groups.size(); y++)
     {
-        for (int x = 0; x < modelinfo[y].meshes.size(); x++)
+        for (int x = 0; x < groups[y].meshes.size(); x++)
         {
-            for (int y = 0; y < modelinfo[y].meshes[x].textures.size(); y++)
+            for (int z = 0; z < groups[y].meshes[x].textures.size(); z++)
             {
-            glDeleteTextures(1, &modelinfo[y].meshes[x].textures[y].id);
+                TextureRegistry::release(groups[y].meshes[x].textures[z].id);
+            }
+            delete groups[y].meshes[x].mesh;
         }
-            delete modelinfo[y].meshes[x].mesh;
+        for (auto &array : groups[y].arrays)
+        {
+            glDeleteVertexArrays(1, &array.second);
         }
     }
+    if (ownPool)
+    {
+        delete pool;
+    }
+    delete frameRing;
 }
 //! Draw each asset as a series of meshes.
-void Model::Draw(Shader *shader, mat4 view, mat4 projection, vector<ModelInfo>model, vector<PointLight>lights, vector<SpotLight>spotLights, vec3 viewPos, int startIndex, bool diffOnly)
+void Model::Draw(Shader *shader, const mat4 &view, const mat4 &projection, const vector<ModelInfo> &model, const vector<PointLight> &lights, const vector<SpotLight> &spotLights, const vec3 &viewPos, int startIndex, bool diffOnly)
 {
-    MeshInfo meshItem;
-    string type;
-    sortIDs();
-    for (int x = 0; x < modelinfo.size(); x++)
+    FrameData frame;
+    frameRing->beginFrame();
+    RingBuffer::fillFrameData(frame, view, projection, viewPos, lights, spotLights);
+    GLintptr offset = frameRing->writeUniform(&frame, sizeof(FrameData));
+    drawQueue.clear();
+    enqueue(&drawQueue, frameRing, shader, model, viewPos, startIndex, diffOnly);
+    frameRing->flush();
+    shader->bindBlock("FrameData", FRAME_BLOCK_BINDING);
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameRing->getBuffer(), offset, sizeof(FrameData));
+    drawQueue.submit();
+    frameRing->endFrame();
+}  
+
+void Model::selectPrograms(ShaderSet *shaders, bool diffOnly, GLuint features)
+{
+    for (int y = 0; y < groups.size(); y++)
+    {
+        for (int x = 0; x < groups[y].meshes.size(); x++)
+        {
+            Mesh *mesh = groups[y].meshes[x].mesh;
+            GLuint variant = mesh->getFeatures(diffOnly) | (multiDraw ? FEATURE_DRAW_DATA : 0) | features;
+            mesh->program = shaders->getVariant(variant);
+        }
+    }
+    cout << "\n\n\tThe models use " << shaders->getShaders().size() << " shader variants.\n\n";
+}
+
+//! projection[1][1] is the cotangent of half the field of view.
+void Model::setLodProjection(const mat4 &projection, int viewportHeight)
+{
+    lodScale = projection[1][1] * 0.5f * (float) viewportHeight;
+}
+
+float Model::matrixScale(const mat4 &model)
+{
+    float scale = 0.0f;
+    for (int x = 0; x < 3; x++)
     {
-        model[x].meshes = modelinfo[x].meshes;
+        float length = sqrt(model[x][0] * model[x][0] + model[x][1] * model[x][1] + model[x][2] * model[x][2]);
+        scale = std::max(scale, length);
     }
-    modelinfo = model;
+    return scale;
+}
+
+void Model::setMultiDraw(bool multiDraw)
+{
+    this->multiDraw = multiDraw;
+}
+
+//! Queue each asset as a series of meshes.
+void Model::enqueue(RenderQueue *queue, RingBuffer *ring, Shader *shader, const vector<ModelInfo> &model, const vec3 &viewPos, int startIndex, bool diffOnly)
+{
+    RenderItem item;
+    updateTransforms(model);
     sortDists(viewPos);
-    for (int y = 0; y < modelinfo.size(); y++)
+    //! Files used more than once are drawn as one instanced call per mesh.
+    for (int y = 0; y < groups.size(); y++)
+    {
+        InstanceGroup &group = groups[y];
+        if (group.members.size() < 2)
+        {
+            continue;
+        }
+        float nearest = modelinfo[group.members[0]].dist;
+        float farthest = nearest;
+        float scale = 0.0f;
+        for (int x = 0; x < group.members.size(); x++)
+        {
+            group.matrices[x] = modelinfo[group.members[x]].model;
+            nearest = std::min(nearest, modelinfo[group.members[x]].dist);
+            farthest = std::max(farthest, modelinfo[group.members[x]].dist);
+            scale = std::max(scale, modelinfo[group.members[x]].scale);
+        }
+        //! The instances share a draw, so the nearest and largest of them chooses the level.
+        float pixels = lodScale * scale / std::max(nearest, 0.01f);
+        GLintptr offset = ring->write(group.matrices.data(), group.matrices.size() * sizeof(mat4));
+        if (offset < 0)
+        {
+            continue;
+        }
+        //! The region moves every frame, so the attributes follow it.
+        for (auto &array : group.arrays)
+        {
+            Mesh::instanceAttributes(array.second, ring->getBuffer(), offset);
+        }
+        for (int x = 0; x < group.meshes.size(); x++)
+        {
+            Mesh *mesh = group.meshes[x].mesh;
+            mesh->setInstanceBuffer(ring->getBuffer(), offset);
+            mesh->fillItem(item, startIndex, (lodScale > 0.0f) ? mesh->selectLod(pixels) : 0);
+            //! With per draw data the queue writes the matrices, next to the mesh's records.
+            item.multiDraw = (multiDraw) && (mesh->program);
+            if ((mesh->getArena() >= 0) && (!item.multiDraw))
+            {
+                item.vao = group.arrays[mesh->getArena()];
+            }
+            item.pass = (mesh->opacity < 1.0f) ? PASS_TRANSPARENT : PASS_OPAQUE;
+            item.shader = mesh->program ? mesh->program : shader;
+            if (!item.shader)
+            {
+                continue;
+            }
+            item.model = nullptr;
+            item.matrices = group.matrices.data();
+            item.instances = group.matrices.size();
+            //! A transparent group starts with its furthest instance, so it is placed by it.
+            item.depth = group.transparent ? farthest : nearest;
+            item.diffOnly = diffOnly;
+            queue->add(item);
+        }
+    }
+    for (int y = 0; y < drawOrder.size(); y++)
     {
-        meshes = modelinfo[y].meshes;
-        int limit = meshes.size();
-        for (int x = 0; x < limit; x++)
+        const ModelInfo &info = modelinfo[drawOrder[y]];
+        if (groups[groupOf[drawOrder[y]]].members.size() > 1)
         {
-            meshItem = meshes[x];
-            type = meshItem.mesh->getType();
+            continue;
+        }
+        float pixels = lodScale * info.scale / std::max(info.dist, 0.01f);
+        for (int x = 0; x < info.meshes.size(); x++)
+        {
+            Mesh *mesh = info.meshes[x].mesh;
             if(debug1)
             {
-                cout << "\n\tDrawing mesh " << x << " from model " << modelinfo[y].path 
-                << " of type " << type;
+                cout << "\n\tQueueing mesh " << x << " from model " << info.path 
+                << " of type " << mesh->type;
             }
-            meshItem.mesh->Draw(shader, view, projection, modelinfo[y].model, lights, spotLights, viewPos, startIndex, diffOnly);
-            startIndex += modelinfo[y].meshes[x].textures.size();
-            if (debug1)
+            mesh->fillItem(item, startIndex, (lodScale > 0.0f) ? mesh->selectLod(pixels) : 0);
+            item.pass = (mesh->opacity < 1.0f) ? PASS_TRANSPARENT : PASS_OPAQUE;
+            item.shader = mesh->program ? mesh->program : shader;
+            if (!item.shader)
             {
-                cout << "\n\t:  " << startIndex;
+                continue;
             }
+            item.model = &info.model;
+            item.matrices = nullptr;
+            item.multiDraw = (multiDraw) && (mesh->program);
+            item.instances = 0;
+            item.depth = info.dist;
+            item.diffOnly = diffOnly;
+            queue->add(item);
         }
     }
 }  
-//! Less than operator for stable_sort.
-bool Model::cmpdist(const ModelInfo &a, const ModelInfo &b)
-{   
-    return a.dist > b.dist;
-}
-
 
-void Model::sortDists(vec3 viewPos)
+/** The caller passes the objects in the same order as they were
+ *  given to the constructor.  Only the transforms are taken, the
+ *  meshes stay where they are.
+ */
+void Model::updateTransforms(const vector<ModelInfo> &model)
 {
-    for (int x = 0; x < modelinfo.size(); x++)
+    int limit = std::min(model.size(), modelinfo.size());
+    for (int x = 0; x < limit; x++)
     {
-        vec3 location = modelinfo[x].location;
-        modelinfo[x].dist = distance(location, viewPos);
-        //!cout << "\n\n\tDistance: " << x << " : " << modelinfo[x].dist;
+        if (modelinfo[x].model != model[x].model)
+        {
+            modelinfo[x].model = model[x].model;
+            modelinfo[x].scale = matrixScale(model[x].model);
+            //! The location follows the translation of the new transform.
+            modelinfo[x].location = vec3(model[x].model[3][0], 
+            model[x].model[3][1], model[x].model[3][2]);
+        }
     }
-    //! Sort uses the algorithm library.
-    sort(modelinfo.begin(), modelinfo.end(), cmpdist);
-}
-//! Less than operator for stable_sort.
-bool Model::cmpid(const ModelInfo &a, const ModelInfo &b)
-{   
-    return a.idval < b.idval;
 }
 
+bool Model::isTransparent(int object)
+{
+    const vector<MeshInfo> &meshes = groups[groupOf[object]].meshes;
+    for (int x = 0; x < meshes.size(); x++)
+    {
+        if (meshes[x].mesh->opacity < 1.0f)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-void Model::sortIDs()
+void Model::sortDists(const vec3 &viewPos)
 {
-    //! Sort uses the algorithm library.
-    sort(modelinfo.begin(), modelinfo.end(), cmpid);
+    for (int x = 0; x < modelinfo.size(); x++)
+    {
+        modelinfo[x].dist = distance(modelinfo[x].location, viewPos);
+    }
+    //! Insertion sort of the transparent objects, furthest first.
+    for (int x = firstTransparent + 1; x < drawOrder.size(); x++)
+    {
+        int item = drawOrder[x];
+        int y = x - 1;
+        while ((y >= firstTransparent) && (modelinfo[drawOrder[y]].dist < modelinfo[item].dist))
+        {
+            drawOrder[y + 1] = drawOrder[y];
+            y--;
+        }
+        drawOrder[y + 1] = item;
+    }
+    //! The instances of a transparent group are drawn in the order of its members.
+    for (InstanceGroup &group : groups)
+    {
+        if ((!group.transparent) || (group.members.size() < 2))
+        {
+            continue;
+        }
+        for (int x = 1; x < group.members.size(); x++)
+        {
+            int item = group.members[x];
+            int y = x - 1;
+            while ((y >= 0) && (modelinfo[group.members[y]].dist < modelinfo[item].dist))
+            {
+                group.members[y + 1] = group.members[y];
+                y--;
+            }
+            group.members[y + 1] = item;
+        }
+    }
 }
 
 
@@ -128,17 +459,167 @@ void Model::loadModel(string path)
 {
     cout << "\n\n\tLoading design:  " << path << "\n\n";
     hasTex = false;
+    directory = path.substr(0, path.find_last_of('/'));
+    vector<CachedMesh> cached;
+    shared_ptr<MappedFile> mapping;
+    //! The resource archive is used as it is, the asset need not be installed.
+    if (MeshCache::loadArchived(path, cached, mapping))
+    {
+        buildCached(path, cached, mapping);
+        return;
+    }
+    GLuint64 key = 0;
+    bool keyed = (MeshCache::isEnabled()) && (MeshCache::contentKey(path, MODEL_IMPORT_FLAGS, maps, key));
+    if ((keyed) && (MeshCache::load(path, key, cached, mapping)))
+    {
+        buildCached(path, cached, mapping);
+        return;
+    }
     Assimp::Importer import;
-    const aiScene* scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs 
-    | aiProcess_GenNormals | aiProcess_GenUVCoords | aiTextureFlags_UseAlpha | aiProcess_CalcTangentSpace);
+    const aiScene* scene = import.ReadFile(path, MODEL_IMPORT_FLAGS);
     
     if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) 
     {
         cout << "Error upon Assimp library import: " << import.GetErrorString() << endl;
         exit(1);
     }
-    directory = path.substr(0, path.find_last_of('/'));
+    decodeTextures(scene);
+    optimizeTotals = MeshOptimizeStats();
     processNode(scene->mRootNode, scene);
+    //! A deferred model keeps the images until finishLoading() uploads them.
+    if (!deferred)
+    {
+        decoded.clear();
+    }
+    if (MeshOptimizer::isEnabled())
+    {
+        MeshOptimizer::printStats(optimizeTotals, path);
+    }
+    if (keyed)
+    {
+        MeshCache::store(path, key, meshes);
+    }
+}
+
+//! The meshes as processMesh() left them, without assimp.
+void Model::buildCached(const string &path, vector<CachedMesh> &cached, shared_ptr<MappedFile> mapping)
+{
+    //! The textures are decoded together, as decodeTextures() does for assimp.
+    vector<DecodedImage> images;
+    for (int x = 0; x < cached.size(); x++)
+    {
+        for (int y = 0; y < cached[x].textures.size(); y++)
+        {
+            //! An archive may have been packed with more maps than are asked for.
+            if (!sampledSlot(cached[x].textures[y].type, maps))
+            {
+                continue;
+            }
+            const string &file = cached[x].textures[y].path;
+            if ((decoded.count(file) == 0) && (!TextureRegistry::contains(file)))
+            {
+                decoded[file] = DecodedImage();
+                images.push_back(DecodedImage());
+                images.back().path = file;
+            }
+        }
+    }
+    CreateImage::decodeAll(images);
+    for (int x = 0; x < images.size(); x++)
+    {
+        decoded[images[x].path] = std::move(images[x]);
+    }
+    for (int x = 0; x < cached.size(); x++)
+    {
+        CachedMesh &entry = cached[x];
+        MeshInfo item;
+        textures.clear();
+        for (int y = 0; y < entry.textures.size(); y++)
+        {
+            Texture texture = entry.textures[y];
+            if (!sampledSlot(texture.type, maps))
+            {
+                continue;
+            }
+            texture.id = TextureFromFile(texture.path);
+            if (texture.id > 0)
+            {
+                textures.push_back(texture);
+            }
+        }
+        //! The meshes only read their vertices, so they may point into the mapping.
+        if (entry.textured)
+        {
+            hasTex = true;
+            MeshTex *meshTexPtr = new MeshTex();
+            meshTexPtr->pool = pool;
+            meshTexPtr->deferSetup = deferred;
+            meshTexPtr->lods = entry.lods;
+            meshTexPtr->setData(const_cast<Vertex*>(entry.vertices), const_cast<GLuint*>(entry.indices),
+            textures, entry.vertSize, entry.indexSize, textures.size());
+            meshTexPtr->opacity = entry.opacity;
+            meshTexPtr->setType("Textured");
+            item.mesh = meshTexPtr;
+            texcount++;
+        }
+        else
+        {
+            hasTex = false;
+            MeshVert *meshVertPtr = new MeshVert();
+            meshVertPtr->pool = pool;
+            meshVertPtr->deferSetup = deferred;
+            meshVertPtr->lods = entry.lods;
+            meshVertPtr->setData(const_cast<Vertex1*>(entry.plainVertices), const_cast<GLuint*>(entry.indices),
+            entry.color, entry.vertSize, entry.indexSize);
+            meshVertPtr->opacity = entry.opacity;
+            meshVertPtr->setType("Untextured");
+            item.mesh = meshVertPtr;
+            vertcount++;
+        }
+        item.textures = textures;
+        meshes.push_back(item);
+    }
+    if (!deferred)
+    {
+        decoded.clear();
+    }
+    meshMappings.push_back(mapping);
+    cout << "\n\n\tLoaded " << meshes.size() << " meshes of " << path << " from the mesh cache.\n\n";
+}
+
+//! Every texture of every material, decoded at once before the meshes are built.
+void Model::decodeTextures(const aiScene* scene)
+{
+    vector<DecodedImage> images;
+    for (GLuint x = 0; x < scene->mNumMaterials; x++)
+    {
+        aiMaterial* material = scene->mMaterials[x];
+        for (const MaterialSlot &slot : materialSlots)
+        {
+            if ((maps & slot.feature) == 0)
+            {
+                continue;
+            }
+            for (GLuint i = 0; i < material->GetTextureCount(slot.type); i++)
+            {
+                aiString str;
+                material->GetTexture(slot.type, i, &str);
+                string file = directory + "/" + string(str.C_Str());
+                //! An image another mesh or model uploaded is not decoded again.
+                if ((decoded.count(file) == 0) && (!TextureRegistry::contains(file)))
+                {
+                    decoded[file] = DecodedImage();
+                    images.push_back(DecodedImage());
+                    images.back().path = file;
+                }
+            }
+        }
+    }
+    CreateImage::decodeAll(images);
+    for (int x = 0; x < images.size(); x++)
+    {
+        decoded[images[x].path] = std::move(images[x]);
+    }
 }
 
 //! Process a node and all subnodes.
@@ -257,35 +738,16 @@ MeshInfo Model::processMesh(aiMesh* mesh, const aiScene* scene)
                         }
                     }
                     material->Get(AI_MATKEY_OPACITY, opacity);
-                    /** Here we check for all the texture types even though we are only using three:
-                     *  diffuse - color, specular - highlights, height - bumps.
-                     */
-                    vector<Texture> noneMaps = loadMaterialTextures(material, aiTextureType_NONE, "texture_none");
-                    textures.insert(textures.end(), noneMaps.begin(), noneMaps.end());
-                    vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-                    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-                    vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-                    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-                    vector<Texture> ambientMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_ambient");
-                    textures.insert(textures.end(), ambientMaps.begin(), ambientMaps.end());
-                    vector<Texture> emissiveMaps = loadMaterialTextures(material, aiTextureType_EMISSIVE, "texture_emissive");
-                    textures.insert(textures.end(), emissiveMaps.begin(), emissiveMaps.end());
-                    vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_height");
-                    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-                    vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_NORMALS, "texture_normal");
-                    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-                    vector<Texture> shininessMaps = loadMaterialTextures(material, aiTextureType_SHININESS, "texture_shininess");
-                    textures.insert(textures.end(), shininessMaps.begin(), shininessMaps.end());
-                    vector<Texture> opacityMaps = loadMaterialTextures(material, aiTextureType_OPACITY, "texture_opacity");
-                    textures.insert(textures.end(), opacityMaps.begin(), opacityMaps.end());
-                    vector<Texture> displacementMaps = loadMaterialTextures(material, aiTextureType_DISPLACEMENT, "texture_displacement");
-                    textures.insert(textures.end(), displacementMaps.begin(), displacementMaps.end());
-                    vector<Texture> lightMaps = loadMaterialTextures(material, aiTextureType_LIGHTMAP, "texture_lightmap");
-                    textures.insert(textures.end(), lightMaps.begin(), lightMaps.end());
-                    vector<Texture> unknownMaps = loadMaterialTextures(material, aiTextureType_UNKNOWN, "texture_unknown");
-                    textures.insert(textures.end(), unknownMaps.begin(), unknownMaps.end());                    texSize = textures.size();
+                    //! Only the maps the shaders sample are loaded.
+                    materialTextures(material, textures);
+                    texSize = textures.size();
                 }
+                vertSize = optimizeMesh((unsigned char *)vertices, sizeof(Vertex), vertSize);
+                buildLods((unsigned char *)vertices, sizeof(Vertex), vertSize);
                 MeshTex *meshTexPtr = new MeshTex();
+                meshTexPtr->pool = pool;
+                meshTexPtr->deferSetup = deferred;
+                meshTexPtr->lods = lods;
                 meshTexPtr->setData(vertices, indices, textures, vertSize, indexSize, texSize);
                 opacity = glm::clamp(opacity, 0.0f, 1.0f);
                 meshTexPtr->opacity = opacity;
@@ -354,7 +816,12 @@ MeshInfo Model::processMesh(aiMesh* mesh, const aiScene* scene)
                         colordiff[x] = color[x];
                     }
                 }
+                vertSize = optimizeMesh((unsigned char *)vertices, sizeof(Vertex1), vertSize);
+                buildLods((unsigned char *)vertices, sizeof(Vertex1), vertSize);
                 MeshVert *meshVertPtr = new MeshVert();
+                meshVertPtr->pool = pool;
+                meshVertPtr->deferSetup = deferred;
+                meshVertPtr->lods = lods;
                 meshVertPtr->setData(vertices, indices, colordiff, 
                 vertSize, indexSize);
                 if (opacity  > 1.0f)
@@ -388,10 +855,75 @@ MeshInfo Model::processMesh(aiMesh* mesh, const aiScene* scene)
     return item;
 }
 
+//! The vertices and the current index array are reordered in place.
+int Model::optimizeMesh(unsigned char *vertices, size_t stride, int vertSize)
+{
+    if (!MeshOptimizer::isEnabled())
+    {
+        return vertSize;
+    }
+    MeshOptimizeStats stats;
+    vertSize = MeshOptimizer::optimize(vertices, stride, vertSize, indices, indexSize, stats);
+    MeshOptimizer::addStats(optimizeTotals, stats);
+    if (debug1)
+    {
+        MeshOptimizer::printStats(stats, "mesh");
+    }
+    return vertSize;
+}
+
+//! The levels are appended to the current index array, which is then replaced.
+void Model::buildLods(const unsigned char *vertices, size_t stride, int vertSize)
+{
+    vector<GLuint> all(indices, indices + indexSize);
+    MeshSimplifier::buildLods(vertices, stride, vertSize, all, lods);
+    if (lods.size() < 2)
+    {
+        lods.clear();
+        return;
+    }
+    delete [] indices;
+    indexSize = all.size();
+    indices = new GLuint[indexSize];
+    for (int x = 0; x < indexSize; x++)
+    {
+        indices[x] = all[x];
+    }
+    if (debug1)
+    {
+        cout << "\n\n\tLevels of detail:";
+        for (int x = 0; x < lods.size(); x++)
+        {
+            cout << "  " << lods[x].indexCount / 3 << " triangles";
+            if (x > 0)
+            {
+                cout << " (cell " << lods[x].error << ")";
+            }
+        }
+        cout << "\n\n";
+    }
+}
+
+//! One pass over the sampled slots of a material.
+void Model::materialTextures(aiMaterial* mat, vector<Texture> &textures)
+{
+    for (const MaterialSlot &slot : materialSlots)
+    {
+        if (maps & slot.feature)
+        {
+            loadMaterialTextures(mat, slot.type, slot.name, textures);
+        }
+        else if ((debug1) && (mat->GetTextureCount(slot.type) > 0))
+        {
+            cout << "\n\n\tSkipping " << mat->GetTextureCount(slot.type) << " " << slot.name 
+            << " textures, the shaders do not sample them.\n\n";
+        }
+    }
+}
+
 //! Check for existing texture and load as needed.
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+void Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName, vector<Texture> &textures)
 {
-    vector<Texture> textures;
     for(GLuint i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString str;
@@ -403,7 +935,6 @@ vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type,
             cout << "\n\n\tTexture directory:  " << directory << " filename:  " << filename 
             << "  type:  " << typeName << "  count:  " << (i + 1) << "\n\n";
         }
-        GLboolean skip = false;
         Texture texture;
         texture.id = TextureFromFile(filename);
         if (texture.id > 0)
@@ -413,25 +944,45 @@ vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type,
             textures.push_back(texture);
         }
     }
-    return textures;
 }  
 
 //! Use the CreateImage class to turn an image into a texture.
 GLint Model::TextureFromFile(string filename)
 {
     //Generate texture ID and load texture data 
-    CreateImage * imageMkr;
     GLuint textureID;
-    glGenTextures(1, &textureID);
-    GLsizei width, height;
-    imageMkr = new CreateImage();
     if (debug1)
     {
         cout << "\n\n\tProcessing:  " << filename << "\n\n";
     }
-    if(imageMkr->setImage(filename))
+    //! An image already uploaded, by this model or another, is shared.
+    textureID = TextureRegistry::acquire(filename);
+    if (textureID > 0)
+    {
+        return textureID;
+    }
+    //! Normally decodeTextures() has done the work and only the upload is left.
+    auto found = decoded.find(filename);
+    if (found == decoded.end())
+    {
+        decoded[filename] = DecodedImage();
+        found = decoded.find(filename);
+        CreateImage::decodeImage(filename, found->second);
+    }
+    if(found->second.ok)
     {
-        textureID = imageMkr->textureObject();
+        //! Off the context thread the upload waits for finishLoading().
+        if (deferred)
+        {
+            return MODEL_PENDING_TEXTURE;
+        }
+        //! A copy of an uploaded image under another name is shared too.
+        textureID = TextureRegistry::acquireContent(filename, found->second.key);
+        if (textureID == 0)
+        {
+            textureID = CreateImage::textureObject(found->second, streamer);
+            TextureRegistry::add(filename, found->second.key, textureID);
+        }
         if (debug1)
         {
             cout << "\n\n\tReturning texture buffer:  " << textureID << "\n\n";
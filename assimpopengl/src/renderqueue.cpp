@@ -0,0 +1,488 @@
+/**********************************************************
+ *   RenderQueue:  A class to collect the draw calls for a
+ *   frame, sort them by pass, program, textures, vertex
+ *   array and depth, and submit them without repeating
+ *   state changes that are already in place.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/renderqueue.h"
+#include "../include/mesh.h"
+
+static_assert(QUEUE_TEXTURE_UNITS <= MAX_TRACKED_UNITS, "The queue tracks every unit it binds");
+
+RenderQueue::RenderQueue(float depthRange)
+{
+    cout << "\n\n\tCreating RenderQueue.\n\n";
+    this->depthRange = depthRange;
+    resetState();
+}
+
+RenderQueue::~RenderQueue()
+{
+    cout << "\n\n\tDestroying RenderQueue.\n\n";
+    if (sampleQuery)
+    {
+        glDeleteQueries(1, &sampleQuery);
+    }
+    if (dataBuffer)
+    {
+        glDeleteBuffers(1, &dataBuffer);
+        glDeleteBuffers(1, &commandBuffer);
+    }
+}
+
+void RenderQueue::clear()
+{
+    items.clear();
+    order.clear();
+    transparent.clear();
+}
+
+void RenderQueue::add(const RenderItem &item)
+{
+    items.push_back(item);
+    items.back().key = makeKey(item);
+    if (item.pass == PASS_TRANSPARENT)
+    {
+        transparent.push_back(items.size() - 1);
+    }
+    else
+    {
+        order.push_back(items.size() - 1);
+    }
+}
+
+/** The key from the most significant bits down:
+ *  pass(4) program(12) textures(16) vao(16) depth(16)
+ *  So opaque items are grouped by state and then drawn front to back.
+ *  With skyFirst the sky and opaque passes swap places.  Transparent
+ *  items are not ordered by their key, see submit().
+ */
+GLuint64 RenderQueue::makeKey(const RenderItem &item)
+{
+    GLuint64 pass = (GLuint64)(item.pass & 0xF);
+    if ((skyFirst) && (item.pass <= PASS_SKY))
+    {
+        pass = PASS_SKY - item.pass;
+    }
+    GLuint64 program = item.shader ? (GLuint64)(item.shader->Program & 0xFFF) : 0;
+    GLuint64 texSet = 0;
+    for (int x = 0; x < item.texCount; x++)
+    {
+        texSet = (texSet * 31) + item.textures[x].id;
+    }
+    texSet &= 0xFFFF;
+    GLuint64 vao = (GLuint64)(item.vao & 0xFFFF);
+    float scaled = glm::clamp(item.depth / depthRange, 0.0f, 1.0f);
+    GLuint64 depth = (GLuint64)(scaled * 65535.0f);
+    return (pass << 60) | (program << 48) | (texSet << 32) | (vao << 16) | depth;
+}
+
+void RenderQueue::bindState(const RenderItem &item)
+{
+    if (item.shader->Program != boundProgram)
+    {
+        item.shader->Use();
+        boundProgram = item.shader->Program;
+        stats.programBinds++;
+    }
+    else
+    {
+        stats.programBindsAvoided++;
+    }
+    for (int y = 0; y < item.texCount; y++)
+    {
+        const TextureBinding &tex = item.textures[y];
+        if ((tex.unit < 0) || (tex.unit >= QUEUE_TEXTURE_UNITS))
+        {
+            if (debug1)
+            {
+                cout << "\n\tTexture unit " << tex.unit << " is not the queue's, not bound.";
+            }
+            continue;
+        }
+        bool tracked = (tex.unit < MAX_TRACKED_UNITS);
+        if ((tracked) && (boundTextures[tex.unit] == tex.id)
+            && (boundTargets[tex.unit] == tex.target))
+        {
+            stats.textureBindsAvoided++;
+            continue;
+        }
+        glActiveTexture(GL_TEXTURE0 + tex.unit);
+        glBindTexture(tex.target, tex.id);
+        if (tracked)
+        {
+            boundTextures[tex.unit] = tex.id;
+            boundTargets[tex.unit] = tex.target;
+        }
+        stats.textureBinds++;
+    }
+    if (item.vao != boundVAO)
+    {
+        glBindVertexArray(item.vao);
+        boundVAO = item.vao;
+        stats.vaoBinds++;
+    }
+    else
+    {
+        stats.vaoBindsAvoided++;
+    }
+}
+
+bool RenderQueue::hasMultiDraw()
+{
+    //! The base instance of a command is only read with GL 4.2 or ARB_base_instance.
+    return ((GLEW_VERSION_4_3) || ((GLEW_ARB_multi_draw_indirect) && (GLEW_ARB_base_instance)));
+}
+
+bool RenderQueue::hasBaseInstance()
+{
+    return ((GLEW_VERSION_4_2) || (GLEW_ARB_base_instance));
+}
+
+//! The items differ only in their per draw data.
+bool RenderQueue::sameState(const RenderItem &a, const RenderItem &b)
+{
+    if ((!b.multiDraw) || (!b.mesh) || (!b.indexed) || ((b.instances > 0) && (!b.matrices)))
+    {
+        return false;
+    }
+    if ((a.pass != b.pass) || (a.shader->Program != b.shader->Program) || (a.vao != b.vao)
+        || (a.mode != b.mode) || (a.startIndex != b.startIndex) || (a.diffOnly != b.diffOnly)
+        || (a.texCount != b.texCount))
+    {
+        return false;
+    }
+    for (int x = 0; x < a.texCount; x++)
+    {
+        if ((a.textures[x].id != b.textures[x].id) || (a.textures[x].unit != b.textures[x].unit)
+            || (a.textures[x].target != b.textures[x].target))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Every item with per draw data is in a run, a run of one when
+ *  nothing next to it shares its state, as its shader reads the
+ *  records in place of the uniforms.
+ */
+void RenderQueue::buildRuns()
+{
+    drawData.clear();
+    commands.clear();
+    runs.clear();
+    DrawData data;
+    for (int x = 0; x < order.size(); x++)
+    {
+        const RenderItem &start = items[order[x]];
+        if (!sameState(start, start))
+        {
+            continue;
+        }
+        MultiDrawRun run;
+        run.first = x;
+        run.command = commands.size();
+        while ((x < order.size()) && (sameState(start, items[order[x]])))
+        {
+            const RenderItem &item = items[order[x]];
+            DrawElementsCommand command;
+            command.count = item.count;
+            command.instanceCount = std::max(item.instances, 1);
+            command.firstIndex = item.first;
+            command.baseVertex = item.baseVertex;
+            command.baseInstance = drawData.size();
+            item.mesh->fillDrawData(data);
+            for (int y = 0; y < command.instanceCount; y++)
+            {
+                data.model = (item.instances > 0) ? item.matrices[y] : (item.model ? *item.model : mat4(1.0f));
+                drawData.push_back(data);
+            }
+            commands.push_back(command);
+            run.items++;
+            x++;
+        }
+        x--;
+        run.commands = run.items;
+        runs.push_back(run);
+    }
+    if (runs.empty())
+    {
+        return;
+    }
+    if (!dataBuffer)
+    {
+        glGenBuffers(1, &dataBuffer);
+        glGenBuffers(1, &commandBuffer);
+    }
+    //! Orphaned each frame, the draws of the last frame keep their copy.
+    glBindBuffer(GL_ARRAY_BUFFER, dataBuffer);
+    glBufferData(GL_ARRAY_BUFFER, drawData.size() * sizeof(DrawData), drawData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (hasMultiDraw())
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsCommand),
+        commands.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
+
+void RenderQueue::drawDataAttributes(GLintptr offset)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, dataBuffer);
+    for (int x = 0; x < DRAW_DATA_ATTRIBUTES; x++)
+    {
+        glVertexAttribPointer(DRAW_DATA_LOCATION + x, 4, GL_FLOAT, GL_FALSE, sizeof(DrawData), 
+        (GLvoid*)(offset + x * sizeof(vec4)));
+        glEnableVertexAttribArray(DRAW_DATA_LOCATION + x);
+        glVertexAttribDivisor(DRAW_DATA_LOCATION + x, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void RenderQueue::drawRun(const MultiDrawRun &run)
+{
+    const RenderItem &item = items[order[run.first]];
+    //! The samplers, the rest of the mesh state is in the records.
+    item.mesh->setUniforms(item.shader, nullptr, item.startIndex);
+    stats.dataDraws += run.commands;
+    bool baseInstance = hasBaseInstance();
+    if (baseInstance)
+    {
+        //! The base instance of each draw picks its records.
+        drawDataAttributes(0);
+    }
+    if (hasMultiDraw())
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glMultiDrawElementsIndirect(item.mode, GL_UNSIGNED_INT,
+        (GLvoid*)(run.command * sizeof(DrawElementsCommand)), run.commands, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        stats.drawCalls++;
+        stats.multiDrawCalls++;
+        return;
+    }
+    for (int x = run.command; x < run.command + run.commands; x++)
+    {
+        const DrawElementsCommand &command = commands[x];
+        GLvoid *first = (GLvoid*)(command.firstIndex * sizeof(GLuint));
+        if (baseInstance)
+        {
+            glDrawElementsInstancedBaseVertexBaseInstance(item.mode, command.count, GL_UNSIGNED_INT,
+            first, command.instanceCount, command.baseVertex, command.baseInstance);
+        }
+        else
+        {
+            drawDataAttributes(command.baseInstance * sizeof(DrawData));
+            if (command.baseVertex)
+            {
+                glDrawElementsInstancedBaseVertex(item.mode, command.count, GL_UNSIGNED_INT,
+                first, command.instanceCount, command.baseVertex);
+            }
+            else
+            {
+                glDrawElementsInstanced(item.mode, command.count, GL_UNSIGNED_INT,
+                first, command.instanceCount);
+            }
+        }
+        stats.drawCalls++;
+    }
+}
+
+void RenderQueue::resetState()
+{
+    //! Nothing is known, so the first use of each binding is made.
+    boundProgram = boundVAO = ~0u;
+    for (int x = 0; x < MAX_TRACKED_UNITS; x++)
+    {
+        boundTextures[x] = ~0u;
+        boundTargets[x] = GL_NONE;
+    }
+}
+
+void RenderQueue::submit()
+{
+    stats = RenderStats();
+    stats.items = items.size();
+    for (const RenderItem &item : items)
+    {
+        if (item.mode == GL_TRIANGLES)
+        {
+            stats.triangles += (GLuint64)(item.count / 3) * std::max(item.instances, 1);
+        }
+    }
+    resetState();
+    const vector<RenderItem> &list = items;
+    //! Sort the indices, the items themselves stay put.
+    sort(order.begin(), order.end(), [&list](int a, int b)
+    {
+        return list[a].key < list[b].key;
+    });
+    /** The transparent pass is last whatever the sky does.  Its items
+     *  come from the callers back to front already (Model keeps its
+     *  draw order from frame to frame), so an insertion sort on the
+     *  exact depth, furthest first, is close to linear.  Equal depths
+     *  keep the order they were added in.
+     */
+    for (int x = 1; x < transparent.size(); x++)
+    {
+        int index = transparent[x];
+        int y = x - 1;
+        while ((y >= 0) && (items[transparent[y]].depth < items[index].depth))
+        {
+            transparent[y + 1] = transparent[y];
+            y--;
+        }
+        transparent[y + 1] = index;
+    }
+    order.insert(order.end(), transparent.begin(), transparent.end());
+    buildRuns();
+    int pass = -1;
+    int run = 0;
+    for (int x = 0; x < order.size(); x++)
+    {
+        const RenderItem &item = items[order[x]];
+        if (item.pass != pass)
+        {
+            endPass(pass);
+            pass = item.pass;
+            beginPass(pass);
+        }
+        bindState(item);
+        if ((run < runs.size()) && (runs[run].first == x))
+        {
+            drawRun(runs[run]);
+            x += runs[run].items - 1;
+            run++;
+            continue;
+        }
+        if (item.mesh)
+        {
+            item.mesh->setUniforms(item.shader, item.model, item.startIndex);
+        }
+        else if (item.model)
+        {
+            item.shader->setMat4("model", *item.model);
+        }
+        if ((item.indexed) && (item.instances > 0) && (item.baseVertex))
+        {
+            glDrawElementsInstancedBaseVertex(item.mode, item.count, GL_UNSIGNED_INT,
+            (GLvoid*)(item.first * sizeof(GLuint)), item.instances, item.baseVertex);
+        }
+        else if ((item.indexed) && (item.instances > 0))
+        {
+            glDrawElementsInstanced(item.mode, item.count, GL_UNSIGNED_INT,
+            (GLvoid*)(item.first * sizeof(GLuint)), item.instances);
+        }
+        else if ((item.indexed) && (item.baseVertex))
+        {
+            glDrawElementsBaseVertex(item.mode, item.count, GL_UNSIGNED_INT,
+            (GLvoid*)(item.first * sizeof(GLuint)), item.baseVertex);
+        }
+        else if (item.indexed)
+        {
+            glDrawElements(item.mode, item.count, GL_UNSIGNED_INT,
+            (GLvoid*)(item.first * sizeof(GLuint)));
+        }
+        else if (item.instances > 0)
+        {
+            glDrawArraysInstanced(item.mode, item.first, item.count, item.instances);
+        }
+        else
+        {
+            glDrawArrays(item.mode, item.first, item.count);
+        }
+        stats.drawCalls++;
+    }
+    endPass(pass);
+    glBindVertexArray(0);
+    if (stats.skyMeasured)
+    {
+        //! Measuring only, so waiting on the result is acceptable.
+        glGetQueryObjectuiv(sampleQuery, GL_QUERY_RESULT, &stats.skySamples);
+    }
+    measure = false;
+    if (debug1)
+    {
+        printStats();
+    }
+}
+
+const RenderStats &RenderQueue::getStats()
+{
+    return stats;
+}
+
+void RenderQueue::printStats()
+{
+    cout << "\n\n\tRender Queue:  " << stats.items << " items, "
+    << stats.drawCalls << " draw calls, " << stats.triangles << " triangles."
+    << "\n\tProgram binds:  " << stats.programBinds << " avoided:  " << stats.programBindsAvoided
+    << "\n\tTexture binds:  " << stats.textureBinds << " avoided:  " << stats.textureBindsAvoided
+    << "\n\tVertex array binds:  " << stats.vaoBinds << " avoided:  " << stats.vaoBindsAvoided;
+    if (stats.dataDraws > 0)
+    {
+        cout << "\n\tDraws from per draw data:  " << stats.dataDraws << " in "
+        << stats.multiDrawCalls << " multi draw calls" 
+        << (hasMultiDraw() ? "." : " (not available, drawn in a loop).");
+    }
+    if (stats.skyMeasured)
+    {
+        cout << "\n\tSky samples passed:  " << stats.skySamples 
+        << (skyFirst ? " (sky drawn first)" : " (sky drawn after the opaque pass)");
+    }
+    cout << "\n\n";
+}
+
+void RenderQueue::beginPass(int pass)
+{
+    if (pass != PASS_SKY)
+    {
+        return;
+    }
+    //! The sky is at the far plane, it passes only where the depth was cleared.
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    if (measure)
+    {
+        if (!sampleQuery)
+        {
+            glGenQueries(1, &sampleQuery);
+        }
+        glBeginQuery(GL_SAMPLES_PASSED, sampleQuery);
+        stats.skyMeasured = true;
+    }
+}
+
+void RenderQueue::endPass(int pass)
+{
+    if (pass != PASS_SKY)
+    {
+        return;
+    }
+    if (measure)
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+    }
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+}
+
+void RenderQueue::measureSkyOnce()
+{
+    measure = true;
+}
+
+void RenderQueue::setSkyFirst(bool skyFirst)
+{
+    this->skyFirst = skyFirst;
+}
+
+bool RenderQueue::getSkyFirst()
+{
+    return skyFirst;
+}
@@ -0,0 +1,208 @@
+/**********************************************************
+ *   ResourceArchive:  A class to read the resources of the
+ *   program out of one indexed archive file.  The archive is
+ *   mapped once and every resource is a view into it, so the
+ *   program starts from one sequential read rather than a
+ *   file open and a decode for each resource.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/resourcearchive.h"
+#include <cstring>
+#include <unistd.h>
+
+ResourceArchive *ResourceArchive::current = nullptr;
+
+ResourceArchive::ResourceArchive()
+{
+    cout << "\n\n\tCreating ResourceArchive.\n\n";
+}
+
+ResourceArchive::~ResourceArchive()
+{
+    cout << "\n\n\tDestroying ResourceArchive.\n\n";
+    if (current == this)
+    {
+        current = nullptr;
+    }
+    close();
+}
+
+bool ResourceArchive::open(const string &file)
+{
+    close();
+    shared_ptr<MappedFile> mapped = make_shared<MappedFile>();
+    if (!mapped->open(file))
+    {
+        return false;
+    }
+    const unsigned char *data = mapped->data();
+    size_t size = mapped->size();
+    ResourceArchiveHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if ((memcmp(header.magic, RESOURCE_ARCHIVE_MAGIC, sizeof(header.magic)) != 0)
+        || (header.version != RESOURCE_ARCHIVE_VERSION)
+        || (header.indexOffset > size)
+        || ((size - header.indexOffset) / sizeof(ResourceEntry) < header.entries))
+    {
+        cout << "\n\n\tThe file " << file << " is not a resource archive of this version.\n\n";
+        return false;
+    }
+    //! Everything is read in now, the resources are used one after another at startup.
+    mapped->willNeed();
+    map<string, ResourceEntry> found;
+    for (GLuint x = 0; x < header.entries; x++)
+    {
+        ResourceEntry entry;
+        memcpy(&entry, data + header.indexOffset + x * sizeof(ResourceEntry), sizeof(entry));
+        if ((entry.offset > size) || (entry.size > size - entry.offset)
+            || (entry.nameOffset > size) || (entry.nameLength > size - entry.nameOffset))
+        {
+            cout << "\n\n\tThe resource archive " << file << " is damaged, it is ignored.\n\n";
+            return false;
+        }
+        found[string((const char *)data + entry.nameOffset, entry.nameLength)] = entry;
+    }
+    index = std::move(found);
+    mapping = mapped;
+    cout << "\n\n\tOpened resource archive " << file << ", " << index.size() << " resources.\n\n";
+    return true;
+}
+
+void ResourceArchive::close()
+{
+    index.clear();
+    //! Views handed out keep the mapping as long as they need it.
+    mapping.reset();
+}
+
+bool ResourceArchive::isOpen()
+{
+    return (mapping != nullptr);
+}
+
+int ResourceArchive::entryCount()
+{
+    return index.size();
+}
+
+bool ResourceArchive::find(const string &name, GLuint kind, ResourceView &view) const
+{
+    auto found = index.find(name);
+    if ((found == index.end()) || (found->second.kind != kind))
+    {
+        return false;
+    }
+    view.data = mapping->data() + found->second.offset;
+    view.size = found->second.size;
+    view.mapping = mapping;
+    if (debug1)
+    {
+        cout << "\n\n\tFound " << name << " in the resource archive, " << view.size << " bytes.\n\n";
+    }
+    return true;
+}
+
+void ResourceArchive::mount(ResourceArchive *archive)
+{
+    current = archive;
+}
+
+ResourceArchive *ResourceArchive::mounted()
+{
+    return current;
+}
+
+bool ResourceArchive::findMounted(const string &name, GLuint kind, ResourceView &view)
+{
+    return (current) && (current->isOpen()) && (current->find(name, kind, view));
+}
+
+bool ResourceArchive::write(const string &file, const vector<ResourcePackItem> &items)
+{
+    string tempFile = file + ".tmp" + to_string(getpid());
+    FILE *archive = fopen(tempFile.c_str(), "wb");
+    if (!archive)
+    {
+        cout << "\n\n\tError opening file " << tempFile << ".\n\n";
+        return false;
+    }
+    ResourceArchiveHeader header;
+    memcpy(header.magic, RESOURCE_ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version = RESOURCE_ARCHIVE_VERSION;
+    header.entries = items.size();
+    header.indexOffset = 0;
+    bool written = (fwrite(&header, sizeof(header), 1, archive) == 1);
+    GLuint64 offset = sizeof(header);
+    vector<ResourceEntry> entries(items.size());
+    vector<unsigned char> block(65536);
+    const unsigned char padding[RESOURCE_ALIGNMENT] = {};
+    for (int x = 0; (x < items.size()) && (written); x++)
+    {
+        //! Each resource starts aligned, so the vertices and levels in it can be used in place.
+        size_t pad = (RESOURCE_ALIGNMENT - (offset % RESOURCE_ALIGNMENT)) % RESOURCE_ALIGNMENT;
+        written = (fwrite(padding, 1, pad, archive) == pad);
+        offset += pad;
+        FILE *source = fopen(items[x].source.c_str(), "rb");
+        if (!source)
+        {
+            cout << "\n\n\tError opening file " << items[x].source << ".\n\n";
+            written = false;
+            break;
+        }
+        entries[x].offset = offset;
+        entries[x].kind = items[x].kind;
+        size_t got;
+        while ((written) && ((got = fread(block.data(), 1, block.size(), source)) > 0))
+        {
+            written = (fwrite(block.data(), 1, got, archive) == got);
+            offset += got;
+        }
+        fclose(source);
+        entries[x].size = offset - entries[x].offset;
+    }
+    header.indexOffset = offset;
+    GLuint64 nameOffset = offset + entries.size() * sizeof(ResourceEntry);
+    for (int x = 0; x < entries.size(); x++)
+    {
+        entries[x].nameOffset = nameOffset;
+        entries[x].nameLength = items[x].name.size();
+        nameOffset += items[x].name.size();
+    }
+    if ((written) && (!entries.empty()))
+    {
+        written = (fwrite(entries.data(), sizeof(ResourceEntry), entries.size(), archive) == entries.size());
+    }
+    for (int x = 0; (x < items.size()) && (written); x++)
+    {
+        written = (fwrite(items[x].name.data(), 1, items[x].name.size(), archive) == items[x].name.size());
+    }
+    //! The header is written again, now that the index offset is known.
+    if (written)
+    {
+        written = (fseek(archive, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, archive) == 1);
+    }
+    if ((fclose(archive) != 0) || (!written))
+    {
+        cout << "\n\n\tError writing file " << tempFile << ".\n\n";
+        remove(path(tempFile));
+        return false;
+    }
+    try
+    {
+        rename(path(tempFile), path(file));
+    }
+    catch(exception exc)
+    {
+        cout << "\n\n\tError storing file " << file << ":  " << exc.what() << "\n\n";
+        return false;
+    }
+    cout << "\n\n\tWrote resource archive " << file << ", " << items.size() << " resources, "
+    << nameOffset << " bytes.\n\n";
+    return true;
+}
@@ -0,0 +1,194 @@
+/**********************************************************
+ *   resourcepacker:  Builds the resource archive of the
+ *   program.  Every file under the resource directory is
+ *   put in it under the path the program opens:  the meshes
+ *   as the mesh cache makes them, the images as the texture
+ *   cache makes them (decoded, with their mip chains), and
+ *   everything else (shaders, sound) as it is.  Built only
+ *   on request:
+ *   make resourcepacker
+ *   resourcepacker [archive] [resource directory]
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/model.h"
+#include "../include/resourcearchive.h"
+#include "../include/texturecache.h"
+#include "../include/meshcache.h"
+#include <SDL2/SDL.h>
+#include <set>
+
+//! The assimp formats, they are packed as meshes.
+static bool isMesh(const string &ext)
+{
+    return (ext == ".obj") || (ext == ".dae") || (ext == ".fbx") || (ext == ".blend")
+    || (ext == ".3ds") || (ext == ".ply") || (ext == ".gltf") || (ext == ".glb");
+}
+
+//! The FreeImage formats, they are packed as decoded textures.
+static bool isImage(const string &ext)
+{
+    return (ext == ".png") || (ext == ".jpg") || (ext == ".jpeg") || (ext == ".bmp")
+    || (ext == ".tga") || (ext == ".tif") || (ext == ".tiff");
+}
+
+/** The Model class needs a context for its buffers, a hidden
+ *  window is enough.
+ */
+static SDL_Window *createContext(SDL_GLContext &context)
+{
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+    {
+        cout << "\n\n\tSDL_Init error:  " << SDL_GetError() << "\n\n";
+        return nullptr;
+    }
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_COMPATIBILITY);
+    SDL_Window *window = SDL_CreateWindow("resourcepacker", 0, 0, 64, 64, SDL_WINDOW_OPENGL|SDL_WINDOW_HIDDEN);
+    if (window == nullptr)
+    {
+        cout << "\n\n\tCreateWindow error:  " << SDL_GetError() << "\n\n";
+        return nullptr;
+    }
+    context = SDL_GL_CreateContext(window);
+    if (context == nullptr)
+    {
+        cout << "\n\n\tCreateContext error:  " << SDL_GetError() << "\n\n";
+        SDL_DestroyWindow(window);
+        return nullptr;
+    }
+    SDL_GL_MakeCurrent(window, context);
+    return window;
+}
+
+int main(int argc, char **argv)
+{
+    string archiveFile = "/usr/share/openglresources/openglresources.pak";
+    string resourceDir = "/usr/share/openglresources";
+    if (argc > 1)
+    {
+        archiveFile = argv[1];
+    }
+    if (argc > 2)
+    {
+        resourceDir = argv[2];
+    }
+    vector<string> meshFiles, rawFiles;
+    set<string> imageFiles;
+    try
+    {
+        for (recursive_directory_iterator it(resourceDir); it != recursive_directory_iterator(); ++it)
+        {
+            if (!is_regular_file(it->path()))
+            {
+                continue;
+            }
+            string file = it->path().string();
+            string ext = it->path().extension().string();
+            transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+            //! The material libraries are part of the mesh entries, an old archive is left out.
+            if ((ext == ".mtl") || (ext == ".pak") || (file.find(".pak.tmp") != string::npos))
+            {
+                continue;
+            }
+            if (isMesh(ext))
+            {
+                meshFiles.push_back(file);
+            }
+            else if (isImage(ext))
+            {
+                imageFiles.insert(file);
+            }
+            else
+            {
+                rawFiles.push_back(file);
+            }
+        }
+    }
+    catch(exception exc)
+    {
+        cout << "\n\n\tError reading directory " << resourceDir << ":  " << exc.what() << "\n\n";
+        return 1;
+    }
+    //! The archive is made of cache files, so the caches must be on.
+    TextureCache::setEnabled(true);
+    MeshCache::setEnabled(true);
+    vector<ResourcePackItem> items;
+    for (int x = 0; x < rawFiles.size(); x++)
+    {
+        ResourcePackItem item;
+        item.name = item.source = rawFiles[x];
+        item.kind = RESOURCE_RAW;
+        items.push_back(item);
+    }
+    SDL_GLContext context = nullptr;
+    SDL_Window *window = meshFiles.empty() ? nullptr : createContext(context);
+    if ((!meshFiles.empty()) && (!window))
+    {
+        return 1;
+    }
+    for (int x = 0; x < meshFiles.size(); x++)
+    {
+        //! Loading the model writes its mesh cache file, with every map so any program can use it.
+        vector<ModelInfo> modelinfo(1);
+        modelinfo[0].path = meshFiles[x];
+        Model *model = new Model(modelinfo);
+        delete model;
+        GLuint64 key;
+        string prefix;
+        vector<CachedMesh> cached;
+        shared_ptr<MappedFile> mapping;
+        if ((!MeshCache::contentKey(meshFiles[x], MODEL_IMPORT_FLAGS, MODEL_ALL_MAPS, key))
+            || (!MeshCache::load(meshFiles[x], key, cached, mapping)))
+        {
+            cout << "\n\n\tNo mesh cache file for " << meshFiles[x] << ", it is left out.\n\n";
+            continue;
+        }
+        ResourcePackItem item;
+        item.name = meshFiles[x];
+        item.source = MeshCache::cacheFile(meshFiles[x], key, prefix);
+        item.kind = RESOURCE_MESH;
+        items.push_back(item);
+        //! The textures of the meshes go in too, wherever they are.
+        for (int y = 0; y < cached.size(); y++)
+        {
+            for (int z = 0; z < cached[y].textures.size(); z++)
+            {
+                imageFiles.insert(cached[y].textures[z].path);
+            }
+        }
+    }
+    if (window)
+    {
+        SDL_GL_DeleteContext(context);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+    for (const string &file : imageFiles)
+    {
+        //! Decoding the image writes its texture cache file.
+        DecodedImage image;
+        GLuint64 key;
+        string prefix;
+        if ((!CreateImage::decodeImage(file, image)) || (!TextureCache::contentKey(file, key)))
+        {
+            cout << "\n\n\tImage file " << file << " could not be decoded, it is left out.\n\n";
+            continue;
+        }
+        ResourcePackItem item;
+        item.name = file;
+        item.source = TextureCache::cacheFile(file, key, prefix);
+        item.kind = RESOURCE_TEXTURE;
+        if (!exists(path(item.source)))
+        {
+            cout << "\n\n\tNo texture cache file for " << file << ", it is left out.\n\n";
+            continue;
+        }
+        items.push_back(item);
+    }
+    cout << "\n\n\tPacking " << rawFiles.size() << " files, " << meshFiles.size() << " meshes and "
+    << imageFiles.size() << " images.\n\n";
+    return ResourceArchive::write(archiveFile, items) ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+/**********************************************************
+ *   RingBuffer:  A class to stream the per frame data (the
+ *   camera, the lights and the instance matrices) to the GPU
+ *   through one buffer object that is written once a frame.
+ *   The buffer is split into regions used in turn, and a
+ *   fence keeps a region from being overwritten while the
+ *   GPU may still read it.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/ringbuffer.h"
+#include <cstring>
+#include <algorithm>
+
+static_assert(sizeof(PointLightBlock) == 64, "PointLightBlock must match std140");
+static_assert(sizeof(SpotLightBlock) == 96, "SpotLightBlock must match std140");
+static_assert(sizeof(FrameData) == 816, "FrameData must match std140");
+
+RingBuffer::RingBuffer(GLsizeiptr regionSize, int regions)
+{
+    cout << "\n\n\tCreating RingBuffer.\n\n";
+    this->regionSize = regionSize;
+    this->regions = regions;
+    fences.resize(regions, nullptr);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlign);
+    GLsizeiptr total = regionSize * regions;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if ((GLEW_VERSION_4_4) || (GLEW_ARB_buffer_storage))
+    {
+        //! Coherent, so no explicit flush is needed for the writes.
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, total, nullptr, flags);
+        mapped = (unsigned char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+        persistent = (mapped != nullptr);
+        if (!persistent)
+        {
+            //! The storage is immutable now, so start over with a new buffer.
+            cout << "\n\n\tCould not map the ring buffer.\n\n";
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        }
+    }
+    if (!persistent)
+    {
+        glBufferData(GL_ARRAY_BUFFER, total, nullptr, GL_STREAM_DRAW);
+        staging.resize(total);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    cout << "\n\n\tRing buffer of " << regions << " x " << regionSize << " bytes, "
+    << (persistent ? "persistently mapped." : "updated with glBufferSubData.") << "\n\n";
+}
+
+RingBuffer::~RingBuffer()
+{
+    cout << "\n\n\tDestroying RingBuffer.\n\n";
+    for (int x = 0; x < fences.size(); x++)
+    {
+        if (fences[x])
+        {
+            glDeleteSync(fences[x]);
+        }
+    }
+    if (persistent)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void RingBuffer::beginFrame()
+{
+    used = 0;
+    GLsync fence = fences[current];
+    if (!fence)
+    {
+        return;
+    }
+    //! Normally the region was finished two frames ago and this returns at once.
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    while ((result != GL_ALREADY_SIGNALED) && (result != GL_CONDITION_SATISFIED))
+    {
+        if (result == GL_WAIT_FAILED)
+        {
+            cout << "\n\n\tRing buffer fence wait failed.\n\n";
+            break;
+        }
+        if (debug1)
+        {
+            cout << "\n\tRing buffer waiting on region " << current;
+        }
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    glDeleteSync(fence);
+    fences[current] = nullptr;
+}
+
+GLintptr RingBuffer::write(const void *data, GLsizeiptr size, GLsizeiptr alignment)
+{
+    GLsizeiptr start = ((used + alignment - 1) / alignment) * alignment;
+    if (start + size > regionSize)
+    {
+        cout << "\n\n\tRing buffer region full, " << size << " bytes dropped.\n\n";
+        return -1;
+    }
+    GLintptr offset = (current * regionSize) + start;
+    unsigned char *dest = persistent ? mapped : staging.data();
+    memcpy(dest + offset, data, size);
+    used = start + size;
+    return offset;
+}
+
+GLintptr RingBuffer::writeUniform(const void *data, GLsizeiptr size)
+{
+    return write(data, size, uniformAlign);
+}
+
+void RingBuffer::flush()
+{
+    if ((persistent) || (used == 0))
+    {
+        return;
+    }
+    GLintptr offset = current * regionSize;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, offset, used, staging.data() + offset);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void RingBuffer::endFrame()
+{
+    if (persistent)
+    {
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    current = (current + 1) % regions;
+}
+
+GLuint RingBuffer::getBuffer()
+{
+    return buffer;
+}
+
+bool RingBuffer::isPersistent()
+{
+    return persistent;
+}
+
+void RingBuffer::fillFrameData(FrameData &frame, const mat4 &view, const mat4 &projection,
+const vec3 &viewPos, const vector<PointLight> &lights, const vector<SpotLight> &spotLights)
+{
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPos = viewPos;
+    frame.pad = 0.0f;
+    //! The shaders loop over every slot, an unused one is zeroed so it adds no light.
+    int points = std::min((int)lights.size(), FRAME_POINT_LIGHTS);
+    int spots = std::min((int)spotLights.size(), FRAME_SPOT_LIGHTS);
+    for (int x = 0; x < points; x++)
+    {
+        fillPointLight(frame.pointLights[x], lights[x]);
+    }
+    memset(frame.pointLights + points, 0, (FRAME_POINT_LIGHTS - points) * sizeof(PointLightBlock));
+    for (int x = 0; x < spots; x++)
+    {
+        fillSpotLight(frame.spotLights[x], spotLights[x]);
+    }
+    memset(frame.spotLights + spots, 0, (FRAME_SPOT_LIGHTS - spots) * sizeof(SpotLightBlock));
+}
+
+void RingBuffer::fillPointLight(PointLightBlock &block, const PointLight &light)
+{
+    block.position = light.position;
+    block.constant = light.constant;
+    block.ambient = light.ambient;
+    block.linear = light.linear;
+    block.diffuse = light.diffuse;
+    block.quadratic = light.quadratic;
+    block.specular = light.specular;
+    block.range = light.range;
+}
+
+void RingBuffer::fillSpotLight(SpotLightBlock &block, const SpotLight &light)
+{
+    block.position = light.position;
+    block.cutOff = light.cutOff;
+    block.direction = light.direction;
+    block.outerCutOff = light.outerCutOff;
+    block.ambient = light.ambient;
+    block.constant = light.constant;
+    block.diffuse = light.diffuse;
+    block.linear = light.linear;
+    block.specular = light.specular;
+    block.quadratic = light.quadratic;
+    block.range = light.range;
+    block.pad[0] = block.pad[1] = block.pad[2] = 0.0f;
+}
@@ -8,6 +8,9 @@
  * ****************************************************************/
 
 #include "../include/shader.h"
+#include "../include/resourcearchive.h"
+#include <cstring>
+#include <unistd.h>
 
 
 Shader::Shader()
@@ -22,243 +25,459 @@ Shader::~Shader()
 }
 
 void Shader::initShader(string vertexPath, string fragmentPath, 
-    string outputFile)
+    string outputFile, const string &defines)
 {
-    string home = getenv("HOME");
-    outputFile =  home + "/.config/" + outputFile;
-    this->outputFile = outputFile;
+    beginShader(vertexPath, fragmentPath, outputFile, defines);
+    finishShader();
+}
+
+void Shader::beginShader(string vertexPath, string fragmentPath, 
+    string outputFile, const string &defines)
+{
+    //! Let the driver use all its compiler threads, once per context is enough.
+    static bool threadsSet = false;
+    if (!threadsSet)
+    {
+        if (GLEW_KHR_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        }
+        else if (GLEW_ARB_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        }
+        threadsSet = true;
+    }
+    this->vertexPath = vertexPath;
+    this->fragmentPath = fragmentPath;
+    if ((!readFile(vertexPath, vertexCode)) || (!readFile(fragmentPath, fragmentCode)))
+    {
+        cout << "\n\n\tError reading the sources for shader:  " 
+        << outputFile << "\n\n";
+        exit(1);
+    }
+    //! The defines are part of the hashed source, each variant has its own binary.
+    insertDefines(vertexCode, defines);
+    insertDefines(fragmentCode, defines);
     int numFormats = 0;
-    GLenum *valFormats;
     glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    vector<GLint> formats(numFormats > 0 ? numFormats : 1, 0);
+    if (numFormats > 0)
+    {
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+    }
+    format = formats[0];
+    canCache = (numFormats > 0);
+    /** The cache file name is a hash of everything the binary depends
+     *  on, so a changed shader, driver or GPU gives a different file
+     *  and a stale binary is never offered to the driver.
+     */
+    const char *vendor = (const char *)glGetString(GL_VENDOR);
+    const char *renderer = (const char *)glGetString(GL_RENDERER);
+    const char *version = (const char *)glGetString(GL_VERSION);
+    cacheKey = hashBytes(vertexCode.data(), vertexCode.size(), FNV_OFFSET);
+    cacheKey = hashBytes(fragmentCode.data(), fragmentCode.size(), cacheKey);
+    cacheKey = hashBytes(vendor, vendor ? strlen(vendor) : 0, cacheKey);
+    cacheKey = hashBytes(renderer, renderer ? strlen(renderer) : 0, cacheKey);
+    cacheKey = hashBytes(version, version ? strlen(version) : 0, cacheKey);
+    cacheKey = hashBytes(formats.data(), formats.size() * sizeof(GLint), cacheKey);
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)cacheKey);
+    string home = getenv("HOME");
+    string stem = path(outputFile).stem().string();
+    cacheDir = home + "/.config/assimpopengl/shadercache";
+    cachePrefix = stem + "-";
+    this->outputFile = cacheDir + "/" + cachePrefix + hex + ".bin";
     Program = glCreateProgram();
-    if (numFormats > 1)
+    pending = true;
+    fromBinary = (canCache) && (loadBinary());
+    if (!fromBinary)
     {
-        valFormats = new GLenum[numFormats];
-        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, (int*)valFormats);
-        for (int x = 0; x < numFormats; x++)
+        startCompile();
+    }
+}
+
+void Shader::startCompile()
+{
+    //! No status is asked for here, that is what would wait on the compiler.
+    const GLchar *vertexSource = vertexCode.c_str();
+    const GLchar *fragmentSource = fragmentCode.c_str();
+    vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex, 1, &vertexSource, nullptr);
+    glCompileShader(vertex);
+    fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment, 1, &fragmentSource, nullptr);
+    glCompileShader(fragment);
+    glProgramParameteri(Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(Program, vertex);
+    glAttachShader(Program, fragment);
+    glLinkProgram(Program);
+}
+
+bool Shader::isReady()
+{
+    if (!pending)
+    {
+        return true;
+    }
+    if ((GLEW_KHR_parallel_shader_compile) || (GLEW_ARB_parallel_shader_compile))
+    {
+        GLint done = GL_FALSE;
+        glGetProgramiv(Program, GL_COMPLETION_STATUS_KHR, &done);
+        return done;
+    }
+    //! Without the extension there is no way to ask without waiting.
+    return false;
+}
+
+void Shader::finishShader()
+{
+    if (!pending)
+    {
+        return;
+    }
+    pending = false;
+    if (fromBinary)
+    {
+        //! The driver may still refuse a binary, then the sources are compiled.
+        glGetProgramiv(Program, GL_LINK_STATUS, &success);
+        if (success)
         {
-            cout << "\n\nFormat " << x << " : " << valFormats[x];
+            cout << "\n\n\tSuccessfully loaded a pre-compiled agregate "
+            << "program binary " << outputFile << ".\n\tThe program has binary format " 
+            << format << ".\n\n";
+            return;
         }
-        format = valFormats[0];
-        cout << "\n\n";
+        cout << "\n\n\tThe driver rejected the cached binary " << outputFile 
+        << ", recompile initiated.\n\n";
+        glDeleteProgram(Program);
+        Program = glCreateProgram();
+        fromBinary = false;
+        startCompile();
+    }
+    bool vertexOk = checkShader(vertex, vertexPath);
+    bool fragmentOk = checkShader(fragment, fragmentPath);
+    if ((!vertexOk) || (!fragmentOk))
+    {
+        cout << "\n\n\tError compiling shaders for shader:  " 
+        << outputFile << "\n\n";
+        exit(1);
+    }
+    glGetProgramiv(Program, GL_LINK_STATUS, &success);
+    glGetProgramiv(Program, GL_INFO_LOG_LENGTH, &infoLength);
+    if (infoLength > 1)
+    {
+        vector<char> infoLog(infoLength);
+        glGetProgramInfoLog(Program, infoLength, NULL, infoLog.data());
+        cout << "\n\n\tShader Program Link Log\n\t" << infoLog.data() 
+        << "\n\tFor shader:  " << outputFile << "\n\n";
+    }
+    if (!success)
+    {
+        cout << "\n\n\tShader Program Link Error for shader:  " << outputFile << "\n\n";
+        exit(-1);
+    }
+    glGetProgramiv(Program, GL_PROGRAM_BINARY_LENGTH, &progLength);
+    cout << "\n\n\tShader agregate binary program created "
+    << "and the program has length " << progLength 
+    << " bytes.\n\n";
+    // Delete the shaders as they're linked into our program now and no longer necessery
+    glDetachShader(Program, vertex);
+    glDetachShader(Program, fragment);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    if ((canCache) && (createBinary()))
+    {
+        cout << "\n\n\tShader program binary " << outputFile 
+        << " compiled and saved.\n\n";
     }
     else
     {
-        valFormats = new GLenum(0);
-        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, (int*) valFormats);
-        format = *valFormats;
+        cout << "\n\n\tShader program binary " << outputFile 
+        << " was not saved.\n\n";
     }
-    FILE *shaderFile;
-    unsigned char c;
-    shaderFile = fopen(outputFile.c_str(), "rb");
+}
+
+bool Shader::loadBinary()
+{
+    FILE *shaderFile = fopen(outputFile.c_str(), "rb");
     if (!shaderFile)
     {
-        cout << "\n\n\tError opening file " << outputFile << ".\n\n";
-        response = false;
+        cout << "\n\n\tNo cached binary " << outputFile << ", compiling.\n\n";
+        return false;
     }
-    else
+    //! One read for the whole file, header and binary.
+    fseek(shaderFile, 0, SEEK_END);
+    long fileSize = ftell(shaderFile);
+    fseek(shaderFile, 0, SEEK_SET);
+    vector<unsigned char> contents(fileSize > 0 ? fileSize : 0);
+    size_t got = fread(contents.data(), 1, contents.size(), shaderFile);
+    fclose(shaderFile);
+    ShaderCacheHeader header;
+    if ((got != contents.size()) || (got < sizeof(ShaderCacheHeader)))
     {
-        GLsizei fileSize = file_size(path(outputFile.c_str()));
-        unsigned char shaderBinary[fileSize];
-        for (int x = 0; x < fileSize; x++)
-        { // standard C I/O file reading loop
-            shaderBinary[x] = fgetc(shaderFile);
-        }
-        glValidateProgram(Program);
-        glGetProgramiv(Program, GL_VALIDATE_STATUS, &response);
-        if (!response)
-        {
-            cout << "\n\n\tInvalid program, recompile initiated.\n\n";
-        }
-        else
-        {
-            glProgramBinary(Program, format, (GLvoid*) shaderBinary, fileSize);
-            cout << "\n\n\tSuccessfully loaded and validated a pre-compiled agregate "
-            << "program binary.\n\tThe program has binary format " 
-            << format << " and size " << fileSize << " bytes.\n\n";
-        }    
+        cout << "\n\n\tThe cached binary " << outputFile << " is truncated.\n\n";
+        return false;
     }
-    if (!response)
+    memcpy(&header, contents.data(), sizeof(ShaderCacheHeader));
+    if ((memcmp(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic)) != 0) 
+        || (header.key != cacheKey) 
+        || (header.length != got - sizeof(ShaderCacheHeader)))
     {
-        glGetProgramiv(Program, GL_INFO_LOG_LENGTH, &response);
-        if (response > 1)
-        {
-            char infoLog[response];
-            glGetProgramInfoLog(Program, response, NULL, infoLog);
-            cout << "\n\n\tError loading shader program binary:  " << infoLog << "\n\n";
-        }
-        vertex = createShader(GL_VERTEX_SHADER, vertexPath);
-        fragment = createShader(GL_FRAGMENT_SHADER, fragmentPath);
-        if ((!vertex) || (!fragment))
-        {
-            cout << "\n\n\tError compiling shaders for shader:  " 
-            << outputFile << "\n\n";
-            exit(1);
-        }
-        glProgramParameteri(Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
-        glAttachShader(Program, vertex);
-        glAttachShader(Program, fragment);
-        glLinkProgram(Program);
-        glGetProgramiv(Program, GL_PROGRAM_BINARY_LENGTH, &progLength);
-        // Print linking errors if any
-        glGetProgramiv(Program, GL_INFO_LOG_LENGTH, &infoLength);
-        if(infoLength > 0)
-        {
-            char infoLog[infoLength];
-            glGetProgramInfoLog(Program, infoLength, NULL, infoLog);
-            cout << "\n\n\tShader Program Link Error\n\t" << infoLog 
-            << "\n\tFor shader:  " << outputFile << "\n\n";
-            exit(-1);
-        }
-        else
-        {
-            cout << "\n\n\tShader agregate binary program created "
-            << "and the program has length " << progLength 
-            << " bytes.\n\n";
-        }
-        // Delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(createBinary())
-        {
-            cout << "\n\n\tShader program binary " << outputFile 
-            << " compiled and saved.\n\n";
-        }
-        else
-        {
-            cout << "\n\n\tShader program binary " << outputFile 
-            << " failed to compile and save.\n\n";
-        }
+        cout << "\n\n\tThe cached binary " << outputFile << " does not match.\n\n";
+        return false;
     }
+    //! The link status is checked in finishShader().
+    glProgramBinary(Program, header.format, contents.data() + sizeof(ShaderCacheHeader), header.length);
+    format = header.format;
+    return true;
 }
 
 unsigned int Shader::createShader(unsigned int type, string fpath)
 {
-    char c;
     string shaderCode;
-    unsigned int shaderobj;
-    FILE *shaderFile = fopen(fpath.c_str(), "r");
-    if (!shaderFile)
+    if (!readFile(fpath, shaderCode))
     {
-        cout << "\n\n\tError opening file " << fpath << ".\n\n";
         return 0;
     }
-    // Read file's buffer contents into streams
-    while ((c = std::fgetc(shaderFile)) != EOF) 
-    { // standard C I/O file reading loop
-        shaderCode += c;
-    }
-    fclose(shaderFile);
     const GLchar* glShaderCode = shaderCode.c_str();
-    // Vertex Shader
-    try
+    unsigned int shaderobj = glCreateShader(type);
+    if (!shaderobj)
     {
-        shaderobj = glCreateShader(type);
-        glGetShaderiv(shaderobj, GL_INFO_LOG_LENGTH, &infoLength);
-        if ((!shaderobj) && (infoLength == 0))
-        {
-            cout << "\n\n\tError creating shader object.\n\n";
-        }
-        else if(infoLength > 0)
-        {
-            char infoLog[infoLength];
-            glGetShaderInfoLog(shaderobj, infoLength, NULL, infoLog);
-            cout << "\n\nShader Program Creation Error\n" << infoLog << endl;
-        }
-        else
-        {
-            cout << "\n\n\tCreated the shader object.\n\n";
-        }
-        glShaderSource(shaderobj, 1, &glShaderCode, nullptr);
-        glCompileShader(shaderobj);
-        // Print compile errors if any
-        glGetShaderiv(shaderobj, GL_INFO_LOG_LENGTH, &infoLength);
-        if ((!shaderobj) && (infoLength == 0))
-        {
-            cout << "\n\n\tError compiling shader object.\n\n";
-        }
-        else if(infoLength > 0)
-        {
-            char infoLog[infoLength];
-            glGetShaderInfoLog(shaderobj, infoLength, NULL, infoLog);
-            cout << "\n\n\tShader compilation error: \n" << infoLog 
-            << "\n\tfor shader " << fpath << "\n\n";
-            glDeleteShader(shaderobj);
-            return 0;
-        }
-        else
-        {
-             cout << "\n\n\tShader compiled.\n\n";
-        }
-        return shaderobj;
+        cout << "\n\n\tError creating shader object.\n\n";
+        return 0;
     }
-    catch(exception exc)
+    glShaderSource(shaderobj, 1, &glShaderCode, nullptr);
+    glCompileShader(shaderobj);
+    if (!checkShader(shaderobj, fpath))
     {
-        cout << "\n\n\tError making shader:  " << exc.what() << "\n\n";
         return 0;
     }
+    return shaderobj;
+}
+
+bool Shader::checkShader(unsigned int shaderobj, const string &fpath)
+{
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shaderobj, GL_COMPILE_STATUS, &compiled);
+    glGetShaderiv(shaderobj, GL_INFO_LOG_LENGTH, &infoLength);
+    if (infoLength > 1)
+    {
+        vector<char> infoLog(infoLength);
+        glGetShaderInfoLog(shaderobj, infoLength, NULL, infoLog.data());
+        cout << "\n\n\tShader compilation log: \n" << infoLog.data() 
+        << "\n\tfor shader " << fpath << "\n\n";
+    }
+    if (!compiled)
+    {
+        glDeleteShader(shaderobj);
+        return false;
+    }
+    cout << "\n\n\tShader compiled:  " << fpath << "\n\n";
+    return true;
+}
+
+bool Shader::readFile(const string &fpath, string &contents)
+{
+    ResourceView view;
+    if (ResourceArchive::findMounted(fpath, RESOURCE_RAW, view))
+    {
+        contents.assign((const char *)view.data, view.size);
+        return true;
+    }
+    FILE *sourceFile = fopen(fpath.c_str(), "rb");
+    if (!sourceFile)
+    {
+        cout << "\n\n\tError opening file " << fpath << ".\n\n";
+        return false;
+    }
+    fseek(sourceFile, 0, SEEK_END);
+    long fileSize = ftell(sourceFile);
+    fseek(sourceFile, 0, SEEK_SET);
+    contents.resize(fileSize > 0 ? fileSize : 0);
+    size_t got = fread(&contents[0], 1, contents.size(), sourceFile);
+    fclose(sourceFile);
+    contents.resize(got);
+    return true;
+}
+
+void Shader::insertDefines(string &source, const string &defines)
+{
+    if (defines.empty())
+    {
+        return;
+    }
+    size_t version = source.find("#version");
+    size_t line = (version == string::npos) ? string::npos : source.find('\n', version);
+    if (line == string::npos)
+    {
+        source = defines + source;
+        return;
+    }
+    source.insert(line + 1, defines);
+}
+
+//! FNV-1a, enough to tell the inputs apart, it is not a secure hash.
+GLuint64 Shader::hashBytes(const void *data, size_t size, GLuint64 hash)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t x = 0; x < size; x++)
+    {
+        hash ^= bytes[x];
+        hash *= FNV_PRIME;
+    }
+    //! A separator, so moving text from one input to the next changes the key.
+    hash ^= 0xFF;
+    hash *= FNV_PRIME;
+    return hash;
 }
 
 void Shader::Use() 
 { 
+    //! The first use is where an unfinished compile is waited for.
+    finishShader();
     glUseProgram(Program); 
 }   
+
 bool Shader::createBinary()
 {
     if (progLength <= 0)
     {
         cout << "\n\n\tShader program length less than one.\n\n";
-        progLength = 1000000;
+        return false;
     }
-    binary = new unsigned char[progLength];
-    glGetProgramBinary(Program, progLength, &progLenRet, &format, (GLvoid*) binary);
-    if (progLength != progLenRet)
+    vector<unsigned char> contents(sizeof(ShaderCacheHeader) + progLength);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(Program, progLength, &progLenRet, &binaryFormat, 
+    (GLvoid*)(contents.data() + sizeof(ShaderCacheHeader)));
+    if (progLenRet <= 0)
     {
-        cout << "\n\n\tWarning program length of " << progLength 
-        << " does not equal the size of the created binary "
-        << progLenRet << " with format " << format
-        << "\n\n";
+        cout << "\n\n\tThe driver returned no program binary.\n\n";
+        return false;
+    }
+    format = binaryFormat;
+    ShaderCacheHeader header;
+    memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic));
+    header.key = cacheKey;
+    header.format = format;
+    header.length = progLenRet;
+    memcpy(contents.data(), &header, sizeof(ShaderCacheHeader));
+    contents.resize(sizeof(ShaderCacheHeader) + progLenRet);
+    try
+    {
+        create_directories(path(cacheDir));
+    }
+    catch(exception exc)
+    {
+        cout << "\n\n\tError creating directory " << cacheDir << ":  " << exc.what() << "\n\n";
+        return false;
     }
+    /** Written to a temporary file and renamed, so another instance
+     *  never reads a half written binary.
+     */
+    string tempFile = outputFile + ".tmp" + to_string(getpid());
     cout << "\n\n\tSaving shader binary at:  " << outputFile << ".\n\n";
-    FILE *shaderFile = fopen(outputFile.c_str(), "wb");
+    FILE *shaderFile = fopen(tempFile.c_str(), "wb");
     if (!shaderFile)
     {
-        cout << "\n\n\tError opening file " << outputFile << ".\n\n";
+        cout << "\n\n\tError opening file " << tempFile << ".\n\n";
         return false;
     }
-    for (int x = 0; x < progLenRet; x++)
-    { // standard C I/O file reading loop
-       fputc(binary[x], shaderFile);
+    size_t put = fwrite(contents.data(), 1, contents.size(), shaderFile);
+    if ((fclose(shaderFile) != 0) || (put != contents.size()))
+    {
+        cout << "\n\n\tError writing file " << tempFile << ".\n\n";
+        remove(path(tempFile));
+        return false;
+    }
+    try
+    {
+        //! The binaries of earlier versions of this shader are of no further use.
+        for (directory_iterator it(cacheDir); it != directory_iterator(); ++it)
+        {
+            string name = it->path().filename().string();
+            if ((name.compare(0, cachePrefix.size(), cachePrefix) == 0) 
+                && (name.size() == cachePrefix.size() + 20)
+                && (it->path().string() != outputFile))
+            {
+                remove(it->path());
+            }
+        }
+        rename(path(tempFile), path(outputFile));
+    }
+    catch(exception exc)
+    {
+        cout << "\n\n\tError storing file " << outputFile << ":  " << exc.what() << "\n\n";
+        return false;
     }
-    delete binary;
     return true;
 }
     
-void Shader::setBool(const std::string name, bool value) const
+void Shader::setBool(const string &name, bool value) const
 {         
-    glUniform1i(glGetUniformLocation(Program, name.c_str()), (int)value); 
+    setBool(name.c_str(), value); 
 }
-void Shader::setInt(const std::string name, int value) const
+void Shader::setInt(const string &name, int value) const
 { 
-    glUniform1i(glGetUniformLocation(Program, name.c_str()), value); 
+    setInt(name.c_str(), value); 
 }
-void Shader::setFloat(const std::string name, float value) const
+void Shader::setFloat(const string &name, float value) const
 { 
-    glUniform1f(glGetUniformLocation(Program, name.c_str()), value); 
+    setFloat(name.c_str(), value); 
 } 
-void Shader::setVec2(const std::string name, vec2 value) const
+void Shader::setVec2(const string &name, const vec2 &value) const
 { 
-    glUniform2fv(glGetUniformLocation(Program, name.c_str()), 1, value_ptr(value)); 
+    setVec2(name.c_str(), value); 
 } 
-void Shader::setVec3(const std::string name, vec3 value) const
+void Shader::setVec3(const string &name, const vec3 &value) const
 { 
-    glUniform3fv(glGetUniformLocation(Program, name.c_str()), 1, value_ptr(value)); 
+    setVec3(name.c_str(), value); 
 } 
-void Shader::setVec4(const std::string name, vec4 value) const
+void Shader::setVec4(const string &name, const vec4 &value) const
 { 
-    glUniform4fv(glGetUniformLocation(Program, name.c_str()), 1, value_ptr(value)); 
+    setVec4(name.c_str(), value); 
 } 
-void Shader::setMat4(const std::string name, mat4 value) const
+void Shader::setMat4(const string &name, const mat4 &value) const
 { 
-    glUniformMatrix4fv(glGetUniformLocation(Program, name.c_str()), 1, GL_FALSE, &value[0][0]); 
+    setMat4(name.c_str(), value); 
 } 
+void Shader::setBool(const GLchar *name, bool value) const
+{         
+    glUniform1i(glGetUniformLocation(Program, name), (int)value); 
+}
+void Shader::setInt(const GLchar *name, int value) const
+{ 
+    glUniform1i(glGetUniformLocation(Program, name), value); 
+}
+void Shader::setFloat(const GLchar *name, float value) const
+{ 
+    glUniform1f(glGetUniformLocation(Program, name), value); 
+} 
+void Shader::setVec2(const GLchar *name, const vec2 &value) const
+{ 
+    glUniform2fv(glGetUniformLocation(Program, name), 1, value_ptr(value)); 
+} 
+void Shader::setVec3(const GLchar *name, const vec3 &value) const
+{ 
+    glUniform3fv(glGetUniformLocation(Program, name), 1, value_ptr(value)); 
+} 
+void Shader::setVec4(const GLchar *name, const vec4 &value) const
+{ 
+    glUniform4fv(glGetUniformLocation(Program, name), 1, value_ptr(value)); 
+} 
+void Shader::setMat4(const GLchar *name, const mat4 &value) const
+{ 
+    glUniformMatrix4fv(glGetUniformLocation(Program, name), 1, GL_FALSE, &value[0][0]); 
+} 
+
+void Shader::bindBlock(const GLchar *name, GLuint binding)
+{
+    finishShader();
+    GLuint index = glGetUniformBlockIndex(Program, name);
+    if (index == GL_INVALID_INDEX)
+    {
+        cout << "\n\n\tThe uniform block " << name << " is not in the program.\n\n";
+        return;
+    }
+    glUniformBlockBinding(Program, index, binding);
+}
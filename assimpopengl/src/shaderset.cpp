@@ -0,0 +1,96 @@
+/*******************************************************************
+ * ShaderSet:  A class to hold the compiled variants of one pair of
+ *  shader files, one for each combination of material features
+ *  actually used.
+ * Edward C. Eberle <eberdeed@eberdeed.net>
+ * March 2020 San Diego, California USA
+ * ****************************************************************/
+
+#include "../include/shaderset.h"
+
+ShaderSet::ShaderSet(string vertexPath, string fragmentPath, string name)
+{
+    cout << "\n\n\tCreating ShaderSet.\n\n";
+    this->vertexPath = vertexPath;
+    this->fragmentPath = fragmentPath;
+    this->name = name;
+}
+
+ShaderSet::~ShaderSet()
+{
+    cout << "\n\n\tDestroying ShaderSet.\n\n";
+    for (auto &variant : variants)
+    {
+        delete variant.second;
+    }
+}
+
+Shader *ShaderSet::getVariant(GLuint features)
+{
+    auto found = variants.find(features);
+    if (found != variants.end())
+    {
+        return found->second;
+    }
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%x.bin", features);
+    cout << "\n\n\tStarting shader variant " << name << suffix << ":\n" << defines(features) << "\n";
+    Shader *shader = new Shader();
+    shader->beginShader(vertexPath, fragmentPath, name + suffix, defines(features));
+    variants[features] = shader;
+    return shader;
+}
+
+vector<Shader*> ShaderSet::getShaders()
+{
+    vector<Shader*> shaders;
+    for (auto &variant : variants)
+    {
+        shaders.push_back(variant.second);
+    }
+    return shaders;
+}
+
+string ShaderSet::defines(GLuint features)
+{
+    string lines;
+    if (features & FEATURE_DIFFUSE_MAP)
+    {
+        lines += "#define HAS_DIFFUSE_MAP\n";
+    }
+    if (features & FEATURE_SPECULAR_MAP)
+    {
+        lines += "#define HAS_SPECULAR_MAP\n";
+    }
+    if (features & FEATURE_NORMAL_MAP)
+    {
+        lines += "#define HAS_NORMAL_MAP\n";
+    }
+    if (features & FEATURE_DIFF_ONLY)
+    {
+        lines += "#define DIFF_ONLY\n";
+    }
+    if (features & FEATURE_PACKED_VERTICES)
+    {
+        lines += "#define PACKED_VERTICES\n";
+    }
+    if (features & FEATURE_DRAW_DATA)
+    {
+        lines += "#define DRAW_DATA\n";
+    }
+    if (features & FEATURE_CLUSTERED_LIGHTS)
+    {
+        lines += "#define CLUSTERED_LIGHTS\n";
+    }
+    return lines;
+}
+
+GLuint ShaderSet::sampledMaps(bool diffOnly)
+{
+    GLuint maps = FEATURE_DIFFUSE_MAP | FEATURE_NORMAL_MAP;
+    if (!diffOnly)
+    {
+        maps |= FEATURE_SPECULAR_MAP;
+    }
+    return maps;
+}
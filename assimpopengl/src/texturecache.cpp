@@ -0,0 +1,208 @@
+/**********************************************************
+ *   TextureCache:  A class to keep each decoded image with
+ *   its whole mip chain in a cache file, keyed by a hash of
+ *   the source image.  On a warm start the cache file is
+ *   mapped and uploaded as it is, with no image decoding.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/texturecache.h"
+#include "../include/shader.h"
+#include "../include/texturestreamer.h"
+#include <cstring>
+#include <unistd.h>
+
+bool TextureCache::enabled = true;
+
+void TextureCache::setEnabled(bool enabled)
+{
+    TextureCache::enabled = enabled;
+}
+
+bool TextureCache::isEnabled()
+{
+    return enabled;
+}
+
+bool TextureCache::contentKey(const string &imagefile, GLuint64 &key)
+{
+    FILE *source = fopen(imagefile.c_str(), "rb");
+    if (!source)
+    {
+        return false;
+    }
+    //! Hashed a block at a time, the blocks are always the same size so the key is too.
+    vector<unsigned char> block(65536);
+    key = FNV_OFFSET;
+    size_t got;
+    while ((got = fread(block.data(), 1, block.size(), source)) > 0)
+    {
+        key = Shader::hashBytes(block.data(), got, key);
+    }
+    fclose(source);
+    GLuint version = TEXTURE_CACHE_VERSION;
+    key = Shader::hashBytes(&version, sizeof(version), key);
+    return true;
+}
+
+string TextureCache::cacheFile(const string &imagefile, GLuint64 key, string &prefix)
+{
+    const char *home = getenv("HOME");
+    if (!home)
+    {
+        return string();
+    }
+    //! Images of the same name in different directories get their own files.
+    GLuint64 where = Shader::hashBytes(imagefile.data(), imagefile.size(), FNV_OFFSET);
+    char hex[32];
+    snprintf(hex, sizeof(hex), "%08x-", (unsigned int)(where & 0xFFFFFFFF));
+    prefix = path(imagefile).stem().string() + "-" + hex;
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+    return string(home) + "/.config/assimpopengl/texturecache/" + prefix + hex + ".tex";
+}
+
+bool TextureCache::load(const string &imagefile, GLuint64 key, DecodedImage &image)
+{
+    string prefix;
+    string file = cacheFile(imagefile, key, prefix);
+    if (file.empty())
+    {
+        return false;
+    }
+    ResourceView view;
+    view.mapping = make_shared<MappedFile>();
+    if (!view.mapping->open(file))
+    {
+        return false;
+    }
+    view.data = view.mapping->data();
+    view.size = view.mapping->size();
+    return mapLevels(imagefile, file, view, &key, image);
+}
+
+bool TextureCache::loadArchived(const string &imagefile, DecodedImage &image)
+{
+    ResourceView view;
+    if (!ResourceArchive::findMounted(imagefile, RESOURCE_TEXTURE, view))
+    {
+        return false;
+    }
+    return mapLevels(imagefile, "archived " + imagefile, view, nullptr, image);
+}
+
+bool TextureCache::mapLevels(const string &imagefile, const string &file, const ResourceView &view,
+const GLuint64 *key, DecodedImage &image)
+{
+    TextureCacheHeader header;
+    if (view.size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, view.data, sizeof(header));
+    if ((memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic)) != 0) 
+        || ((key) && (header.key != *key))
+        || (header.levels != TextureStreamer::levelCount(header.width, header.height)))
+    {
+        cout << "\n\n\tThe texture cache file " << file << " does not match, it is ignored.\n\n";
+        return false;
+    }
+    image.path = imagefile;
+    image.width = header.width;
+    image.height = header.height;
+    image.format = header.format;
+    image.key = header.key;
+    image.levels.resize(header.levels);
+    size_t offset = sizeof(header);
+    for (int x = 0; x < header.levels; x++)
+    {
+        image.levels[x] = view.data + offset;
+        offset += image.levelSize(x);
+    }
+    if (offset != view.size)
+    {
+        cout << "\n\n\tThe texture cache file " << file << " is the wrong size, it is ignored.\n\n";
+        image.levels.clear();
+        return false;
+    }
+    image.mapping = view.mapping;
+    //! The pixels are in the mapping, nothing of the decode is kept.
+    vector<unsigned char>().swap(image.pixels);
+    image.ok = true;
+    return true;
+}
+
+bool TextureCache::store(const string &imagefile, GLuint64 key, DecodedImage &image)
+{
+    string prefix;
+    string file = cacheFile(imagefile, key, prefix);
+    if ((file.empty()) || (!image.ok))
+    {
+        return false;
+    }
+    string dir = path(file).parent_path().string();
+    try
+    {
+        create_directories(path(dir));
+    }
+    catch(exception exc)
+    {
+        cout << "\n\n\tError creating directory " << dir << ":  " << exc.what() << "\n\n";
+        return false;
+    }
+    vector<vector<unsigned char>> chain = TextureStreamer::buildMipChain(image.pixels.data(),
+    image.width, image.height);
+    TextureCacheHeader header;
+    memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+    header.key = key;
+    header.width = image.width;
+    header.height = image.height;
+    header.levels = chain.size();
+    header.format = image.format;
+    /** Written to a temporary file and renamed, so another thread
+     *  or instance never maps a half written file.
+     */
+    char hex[32];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+    string tempFile = file + ".tmp" + to_string(getpid()) + "-" + hex;
+    FILE *cache = fopen(tempFile.c_str(), "wb");
+    if (!cache)
+    {
+        cout << "\n\n\tError opening file " << tempFile << ".\n\n";
+        return false;
+    }
+    bool written = (fwrite(&header, sizeof(header), 1, cache) == 1);
+    for (int x = 0; (x < chain.size()) && (written); x++)
+    {
+        written = (fwrite(chain[x].data(), 1, chain[x].size(), cache) == chain[x].size());
+    }
+    if ((fclose(cache) != 0) || (!written))
+    {
+        cout << "\n\n\tError writing file " << tempFile << ".\n\n";
+        remove(path(tempFile));
+        return false;
+    }
+    try
+    {
+        //! The files of earlier versions of this image are of no further use.
+        for (directory_iterator it(dir); it != directory_iterator(); ++it)
+        {
+            string name = it->path().filename().string();
+            if ((name.compare(0, prefix.size(), prefix) == 0)
+                && (name.size() == prefix.size() + 20)
+                && (it->path().string() != file))
+            {
+                remove(it->path());
+            }
+        }
+        rename(path(tempFile), path(file));
+    }
+    catch(exception exc)
+    {
+        cout << "\n\n\tError storing file " << file << ":  " << exc.what() << "\n\n";
+        return false;
+    }
+    cout << "\n\n\tSaved texture cache file " << file << ".\n\n";
+    //! Used from the mapping from now on, the same as on a warm start.
+    return load(imagefile, key, image);
+}
@@ -0,0 +1,121 @@
+/**********************************************************
+ *   TextureRegistry:  A class to share the texture objects
+ *   of the whole process.  A texture is found by the path
+ *   of its image or by a hash of the image's contents, so an
+ *   image used by many meshes and models is decoded and
+ *   uploaded once.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/textureregistry.h"
+
+mutex TextureRegistry::lock;
+map<GLuint, RegisteredTexture> TextureRegistry::textures;
+map<string, GLuint> TextureRegistry::byPath;
+map<GLuint64, GLuint> TextureRegistry::byKey;
+int TextureRegistry::shared = 0;
+
+GLuint TextureRegistry::acquire(const string &imagefile)
+{
+    lock_guard<mutex> guard(lock);
+    auto found = byPath.find(imagefile);
+    if (found == byPath.end())
+    {
+        return 0;
+    }
+    textures[found->second].refs++;
+    shared++;
+    return found->second;
+}
+
+GLuint TextureRegistry::acquireContent(const string &imagefile, GLuint64 key)
+{
+    lock_guard<mutex> guard(lock);
+    auto found = byKey.find(key);
+    if ((key == 0) || (found == byKey.end()))
+    {
+        return 0;
+    }
+    RegisteredTexture &texture = textures[found->second];
+    texture.refs++;
+    shared++;
+    //! The same image under another name, or a copy of it.
+    if (byPath.count(imagefile) == 0)
+    {
+        byPath[imagefile] = texture.id;
+        texture.paths.push_back(imagefile);
+    }
+    return texture.id;
+}
+
+void TextureRegistry::add(const string &imagefile, GLuint64 key, GLuint id)
+{
+    if (id == 0)
+    {
+        return;
+    }
+    lock_guard<mutex> guard(lock);
+    RegisteredTexture &texture = textures[id];
+    texture.id = id;
+    texture.key = key;
+    texture.refs++;
+    texture.paths.push_back(imagefile);
+    byPath[imagefile] = id;
+    if (key != 0)
+    {
+        byKey[key] = id;
+    }
+}
+
+void TextureRegistry::release(GLuint id)
+{
+    lock_guard<mutex> guard(lock);
+    auto found = textures.find(id);
+    if (found == textures.end())
+    {
+        //! Not shared through the registry, it belongs to the caller alone.
+        glDeleteTextures(1, &id);
+        return;
+    }
+    if (--found->second.refs > 0)
+    {
+        return;
+    }
+    for (int x = 0; x < found->second.paths.size(); x++)
+    {
+        byPath.erase(found->second.paths[x]);
+    }
+    auto keyed = byKey.find(found->second.key);
+    if ((keyed != byKey.end()) && (keyed->second == id))
+    {
+        byKey.erase(keyed);
+    }
+    textures.erase(found);
+    glDeleteTextures(1, &id);
+}
+
+bool TextureRegistry::contains(const string &imagefile)
+{
+    lock_guard<mutex> guard(lock);
+    return (byPath.count(imagefile) > 0);
+}
+
+int TextureRegistry::refCount(GLuint id)
+{
+    lock_guard<mutex> guard(lock);
+    auto found = textures.find(id);
+    return (found == textures.end()) ? 0 : found->second.refs;
+}
+
+void TextureRegistry::printStats()
+{
+    lock_guard<mutex> guard(lock);
+    int refs = 0;
+    for (auto &texture : textures)
+    {
+        refs += texture.second.refs;
+    }
+    cout << "\n\n\tTexture registry:  " << textures.size() << " textures, " << refs 
+    << " references, " << shared << " uploads saved.\n\n";
+}
@@ -0,0 +1,481 @@
+/**********************************************************
+ *   TextureStreamer:  A class to upload textures through a
+ *   pool of pixel buffer objects.  The mip chain is built on
+ *   the CPU and sent smallest level first, a few megabytes a
+ *   frame, so a texture can be drawn at low resolution at
+ *   once while the full resolution levels stream in.
+ *   Created by: Edward Charles Eberle <eberdeed@eberdeed.net>
+ *   March 2020 San Diego, California USA
+ * ********************************************************/
+
+#include "../include/texturestreamer.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+TextureStreamer::TextureStreamer(int buffers, GLsizeiptr frameBudget)
+{
+    cout << "\n\n\tCreating TextureStreamer.\n\n";
+    this->frameBudget = frameBudget;
+    bool immutable = (GLEW_VERSION_4_2) || (GLEW_ARB_texture_storage);
+    slots.resize(buffers);
+    for (int x = 0; x < slots.size(); x++)
+    {
+        glGenBuffers(1, &slots[x].buffer);
+    }
+    cout << "\n\n\tStreaming textures through " << buffers << " pixel buffers, "
+    << (immutable ? "with immutable storage." : "with glTexImage storage.") << "\n\n";
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    cout << "\n\n\tDestroying TextureStreamer.\n\n";
+    for (int x = 0; x < slots.size(); x++)
+    {
+        if (slots[x].fence)
+        {
+            glDeleteSync(slots[x].fence);
+        }
+        glDeleteBuffers(1, &slots[x].buffer);
+    }
+}
+
+GLint TextureStreamer::levelCount(GLsizei width, GLsizei height)
+{
+    GLint levels = 1;
+    GLsizei size = std::max(width, height);
+    while (size > 1)
+    {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+void TextureStreamer::halveImage(const unsigned char *src, GLsizei width, GLsizei height,
+unsigned char *dst, GLsizei dstWidth, GLsizei dstHeight)
+{
+    for (GLsizei y = 0; y < dstHeight; y++)
+    {
+        //! At a size of one the same row or column is used twice.
+        const unsigned char *row0 = src + (size_t)std::min(y * 2, height - 1) * width * 4;
+        const unsigned char *row1 = src + (size_t)std::min(y * 2 + 1, height - 1) * width * 4;
+        unsigned char *out = dst + (size_t)y * dstWidth * 4;
+        for (GLsizei x = 0; x < dstWidth; x++)
+        {
+            size_t x0 = (size_t)std::min(x * 2, width - 1) * 4;
+            size_t x1 = (size_t)std::min(x * 2 + 1, width - 1) * 4;
+            for (int c = 0; c < 4; c++)
+            {
+                out[x * 4 + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c]
+                + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+vector<vector<unsigned char>> TextureStreamer::buildMipChain(const unsigned char *pixels,
+GLsizei width, GLsizei height)
+{
+    GLint levels = levelCount(width, height);
+    vector<vector<unsigned char>> chain(levels);
+    chain[0].assign(pixels, pixels + (size_t)width * height * 4);
+    for (GLint x = 1; x < levels; x++)
+    {
+        GLsizei srcWidth = std::max(width >> (x - 1), 1);
+        GLsizei srcHeight = std::max(height >> (x - 1), 1);
+        GLsizei dstWidth = std::max(width >> x, 1);
+        GLsizei dstHeight = std::max(height >> x, 1);
+        chain[x].resize((size_t)dstWidth * dstHeight * 4);
+        halveImage(chain[x - 1].data(), srcWidth, srcHeight, chain[x].data(), dstWidth, dstHeight);
+    }
+    return chain;
+}
+
+void TextureStreamer::allocate(GLenum target, GLint levels, GLsizei width, GLsizei height, GLsizei depth)
+{
+    if ((GLEW_VERSION_4_2) || (GLEW_ARB_texture_storage))
+    {
+        if (target == GL_TEXTURE_2D_ARRAY)
+        {
+            glTexStorage3D(target, levels, GL_RGBA8, width, height, depth);
+        }
+        else
+        {
+            glTexStorage2D(target, levels, GL_RGBA8, width, height);
+        }
+        return;
+    }
+    //! Every level is defined, so the texture is complete whatever the base level.
+    for (GLint x = 0; x < levels; x++)
+    {
+        GLsizei levelWidth = std::max(width >> x, 1);
+        GLsizei levelHeight = std::max(height >> x, 1);
+        if (target == GL_TEXTURE_2D_ARRAY)
+        {
+            glTexImage3D(target, x, GL_RGBA8, levelWidth, levelHeight, depth, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        else if (target == GL_TEXTURE_CUBE_MAP)
+        {
+            for (int face = 0; face < 6; face++)
+            {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, x, GL_RGBA8, levelWidth,
+                levelHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+        else
+        {
+            glTexImage2D(target, x, GL_RGBA8, levelWidth, levelHeight, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+    }
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+void TextureStreamer::upload(const StreamJob &job, const GLvoid *pixels)
+{
+    if (job.target == GL_TEXTURE_2D_ARRAY)
+    {
+        glTexSubImage3D(job.imageTarget, job.level, 0, 0, job.layer, job.width, job.height, job.depth,
+        job.format, GL_UNSIGNED_BYTE, pixels);
+    }
+    else
+    {
+        glTexSubImage2D(job.imageTarget, job.level, 0, 0, job.width, job.height,
+        job.format, GL_UNSIGNED_BYTE, pixels);
+    }
+}
+
+void TextureStreamer::track(GLuint texture, GLenum target, GLint levels)
+{
+    StreamTexture state;
+    state.target = target;
+    state.baseLevel = state.resident = levels;
+    state.remaining.resize(levels, 0);
+    streaming[texture] = state;
+}
+
+void TextureStreamer::enqueue(vector<StreamJob> &jobs)
+{
+    for (int x = 0; x < jobs.size(); x++)
+    {
+        StreamTexture &state = streaming[jobs[x].texture];
+        //! The small levels are sent from client memory, to the bound texture.
+        if (std::max(jobs[x].width, jobs[x].height) <= STREAM_RESIDENT_SIZE)
+        {
+            upload(jobs[x], jobs[x].bytes());
+            state.resident = std::min(state.resident, jobs[x].level);
+            continue;
+        }
+        state.remaining[jobs[x].level]++;
+        //! Kept in size order, so every texture gets its small levels first.
+        auto place = upper_bound(pending.begin(), pending.end(), jobs[x].size,
+        [](GLsizeiptr size, const StreamJob &job)
+        {
+            return size < job.size;
+        });
+        pending.insert(place, std::move(jobs[x]));
+    }
+}
+
+void TextureStreamer::settle(GLuint texture)
+{
+    auto found = streaming.find(texture);
+    if (found == streaming.end())
+    {
+        return;
+    }
+    StreamTexture &state = found->second;
+    state.baseLevel = std::min(state.resident, (GLint)state.remaining.size() - 1);
+    glTexParameteri(state.target, GL_TEXTURE_BASE_LEVEL, state.baseLevel);
+    bool queued = false;
+    for (int x = 0; x < state.remaining.size(); x++)
+    {
+        queued = queued || (state.remaining[x] > 0);
+    }
+    if ((state.baseLevel == 0) || (!queued))
+    {
+        streaming.erase(found);
+        return;
+    }
+    if (!timing)
+    {
+        timing = true;
+        started = chrono::system_clock::now();
+    }
+}
+
+void TextureStreamer::imageJobs(const DecodedImage &image, GLuint texture, GLenum target, 
+GLenum imageTarget, vector<StreamJob> &jobs, GLint layer)
+{
+    GLint levels = levelCount(image.width, image.height);
+    vector<vector<unsigned char>> chain;
+    if (image.levelCount() != levels)
+    {
+        chain = buildMipChain(image.level(0), image.width, image.height);
+    }
+    for (GLint x = 0; x < levels; x++)
+    {
+        StreamJob job;
+        job.texture = texture;
+        job.target = target;
+        job.imageTarget = imageTarget;
+        job.level = x;
+        job.layer = layer;
+        job.width = std::max(image.width >> x, 1);
+        job.height = std::max(image.height >> x, 1);
+        job.format = image.format;
+        job.size = image.levelSize(x);
+        if (chain.empty())
+        {
+            //! Sent straight from the mapped cache file.
+            job.data = image.level(x);
+            job.mapping = image.mapping;
+        }
+        else
+        {
+            job.pixels = std::move(chain[x]);
+        }
+        jobs.push_back(std::move(job));
+    }
+}
+
+GLuint TextureStreamer::stream2D(const DecodedImage &image)
+{
+    if (!image.ok)
+    {
+        return 0;
+    }
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLint levels = levelCount(image.width, image.height);
+    allocate(GL_TEXTURE_2D, levels, image.width, image.height, 1);
+    track(textureID, GL_TEXTURE_2D, levels);
+    vector<StreamJob> jobs;
+    imageJobs(image, textureID, GL_TEXTURE_2D, GL_TEXTURE_2D, jobs);
+    enqueue(jobs);
+    settle(textureID);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return textureID;
+}
+
+GLuint TextureStreamer::streamCube(const vector<DecodedImage> &faces)
+{
+    int first = -1;
+    for (int x = 0; (x < faces.size()) && (first < 0); x++)
+    {
+        first = faces[x].ok ? x : -1;
+    }
+    if (first < 0)
+    {
+        return 0;
+    }
+    GLsizei width = faces[first].width;
+    GLsizei height = faces[first].height;
+    GLint levels = levelCount(width, height);
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    allocate(GL_TEXTURE_CUBE_MAP, levels, width, height, 1);
+    track(textureID, GL_TEXTURE_CUBE_MAP, levels);
+    vector<StreamJob> jobs;
+    for (int face = 0; (face < faces.size()) && (face < 6); face++)
+    {
+        if ((!faces[face].ok) || (faces[face].width != width) || (faces[face].height != height))
+        {
+            cout << "\n\n\tSky box face " << faces[face].path << " is missing or the wrong size.\n\n";
+            continue;
+        }
+        imageJobs(faces[face], textureID, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, jobs);
+    }
+    enqueue(jobs);
+    settle(textureID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    return textureID;
+}
+
+GLuint TextureStreamer::createArray(GLsizei width, GLsizei height, GLsizei depth)
+{
+    GLint levels = levelCount(width, height);
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    allocate(GL_TEXTURE_2D_ARRAY, levels, width, height, depth);
+    track(textureID, GL_TEXTURE_2D_ARRAY, levels);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return textureID;
+}
+
+void TextureStreamer::streamLayer(GLuint texture, GLint layer, const DecodedImage &image)
+{
+    vector<StreamJob> jobs;
+    imageJobs(image, texture, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_2D_ARRAY, jobs, layer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    enqueue(jobs);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureStreamer::finishArray(GLuint texture)
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    settle(texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+GLuint TextureStreamer::stream2DArray(const vector<DecodedImage> &layers)
+{
+    bool ok = (layers.size() > 0);
+    for (int x = 0; x < layers.size(); x++)
+    {
+        ok = ok && (layers[x].ok) && (layers[x].width == layers[0].width)
+        && (layers[x].height == layers[0].height);
+    }
+    if (!ok)
+    {
+        return 0;
+    }
+    GLuint textureID = createArray(layers[0].width, layers[0].height, layers.size());
+    for (int x = 0; x < layers.size(); x++)
+    {
+        streamLayer(textureID, x, layers[x]);
+    }
+    finishArray(textureID);
+    return textureID;
+}
+
+void TextureStreamer::start(StreamSlot &slot, StreamJob &job)
+{
+    GLsizeiptr size = job.size;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    if (size > slot.capacity)
+    {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        slot.capacity = size;
+    }
+    //! The fence has passed, nothing reads the buffer, so the old contents are discarded.
+    void *dest = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dest)
+    {
+        memcpy(dest, job.bytes(), size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    else
+    {
+        glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, size, job.bytes());
+    }
+    //! With the buffer bound the pointer is an offset into it and the call returns at once.
+    glBindTexture(job.target, job.texture);
+    upload(job, (const GLvoid*)0);
+    glBindTexture(job.target, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.texture = job.texture;
+    slot.level = job.level;
+    if (debug1)
+    {
+        cout << "\n\tStreaming texture " << job.texture << " level " << job.level
+        << ", " << size << " bytes.";
+    }
+}
+
+void TextureStreamer::complete(GLuint texture, GLint level)
+{
+    auto found = streaming.find(texture);
+    if (found == streaming.end())
+    {
+        return;
+    }
+    StreamTexture &state = found->second;
+    state.remaining[level]--;
+    GLint base = state.baseLevel;
+    while ((base > 0) && (state.remaining[base - 1] == 0))
+    {
+        base--;
+    }
+    if (base != state.baseLevel)
+    {
+        state.baseLevel = base;
+        glBindTexture(state.target, texture);
+        glTexParameteri(state.target, GL_TEXTURE_BASE_LEVEL, base);
+        glBindTexture(state.target, 0);
+    }
+    if (base == 0)
+    {
+        streaming.erase(found);
+    }
+}
+
+void TextureStreamer::update()
+{
+    //! Retire the copies that are done, without waiting on the ones that are not.
+    for (int x = 0; x < slots.size(); x++)
+    {
+        if (!slots[x].fence)
+        {
+            continue;
+        }
+        GLenum result = glClientWaitSync(slots[x].fence, 0, 0);
+        if ((result == GL_ALREADY_SIGNALED) || (result == GL_CONDITION_SATISFIED)
+            || (result == GL_WAIT_FAILED))
+        {
+            glDeleteSync(slots[x].fence);
+            slots[x].fence = nullptr;
+            complete(slots[x].texture, slots[x].level);
+        }
+    }
+    //! At least one upload is started, however large, so every level gets its turn.
+    GLsizeiptr spent = 0;
+    for (int x = 0; (x < slots.size()) && (!pending.empty()); x++)
+    {
+        if (slots[x].fence)
+        {
+            continue;
+        }
+        GLsizeiptr size = pending.front().size;
+        if ((spent > 0) && (spent + size > frameBudget))
+        {
+            break;
+        }
+        start(slots[x], pending.front());
+        pending.pop_front();
+        spent += size;
+    }
+    if ((timing) && (isIdle()))
+    {
+        timing = false;
+        auto finish = chrono::system_clock::now();
+        cout << "\n\n\tTextures streamed in "
+        << chrono::duration_cast<chrono::milliseconds>(finish - started).count() << " ms.\n\n";
+    }
+}
+
+void TextureStreamer::finish()
+{
+    GLsizeiptr budget = frameBudget;
+    frameBudget = numeric_limits<GLsizeiptr>::max();
+    while (!isIdle())
+    {
+        update();
+        glFinish();
+    }
+    frameBudget = budget;
+}
+
+bool TextureStreamer::isIdle()
+{
+    if (!pending.empty())
+    {
+        return false;
+    }
+    for (int x = 0; x < slots.size(); x++)
+    {
+        if (slots[x].fence)
+        {
+            return false;
+        }
+    }
+    return true;
+}
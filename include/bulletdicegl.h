@@ -20,6 +20,13 @@
 #include "createimage.h"
 #include "diceroll.h"
 
+//! The stages of the loading thread, for the progress bar.
+#define LOAD_STAGES 4
+//! The milliseconds of mesh and texture uploads in one loading frame.
+#define LOAD_FRAME_BUDGET 8.0
+//! How far the lights reach, past the stage so it looks as it did when they reached everything.
+#define LIGHT_RANGE 1000.0f
+
 /**   \class BulletDiceGL A class to emulate the roll of a
  *   pair of dice in OpenGL.  SDL2 is used to provide 
  *   windowing support.
@@ -35,12 +42,29 @@ public:
     ~BulletDiceGL();
 
 protected:
+    /** \brief Read and decode the assets on a loading thread while
+     *  the window shows a progress bar, then upload them a few
+     *  milliseconds a frame.
+     */
+    void loadAssets();
+    /** \brief The loading thread:  everything that does not need
+     *  the GL context.
+     */
+    void loadWorker();
+    //! \brief Handle the window events while loading.
+    void loadEvents();
+    //! \brief Draw the progress bar, fraction from 0 to 1, and show it.
+    void drawProgress(float fraction);
     /** \brief  Pass the blender objects to the program.
      */
     void setupObjects();
     /** \brief Create the surrounding sky box.
      */
     void createSkyBox();
+    /** \brief Finish the shader programs started in the constructor,
+     *  bind their frame block and set their samplers.
+     */
+    void setupShaders();
     /** \brief The event loop.
      */
     void execLoop();
@@ -93,10 +117,12 @@ protected:
     //! \brief Sets the increment angles for ongoing rotation.
     void randAngles(int index);
     
-    /** \brief Calculates the floor and walls and provides
-     *  the supporting OpenGL vertex and array buffers.
+    /** \brief Calculates the floor and walls, the vertices
+     *  are left in cornerVerts.
      */
     void calcQuad();
+    //! \brief Provide the OpenGL vertex and array buffers of the floor and walls.
+    void uploadQuad();
     
     //! \brief Functions to print various types of debug data.
     void printMat4(mat4 matVal);
@@ -119,6 +145,13 @@ protected:
     unsigned int skyboxVAO, skyboxVBO, skyBox, VAO, VBO, wallTex;
     //! Tile textures for the floor and walls.
     vector<string>tileNames;
+    //! The felt and sky box images, decoded by the loading thread.
+    vector<DecodedImage> feltLayers, skyFaces;
+    //! The interleaved floor and wall vertices, waiting for uploadQuad().
+    vector<float> cornerVerts;
+    //! The loading thread's progress.
+    atomic<int> loadStage;
+    atomic<bool> loadDone;
     //! The array of names to add to tileNames.
     string feltNames[3] =
     {
@@ -139,6 +172,20 @@ protected:
     DiceRoll *diceRoller;
     //! Pointer to the model class, which is in the libassimpopengl.so.
     Model *model;
+    /** \brief The render queue sorts the frame's draw calls by 
+     *  state, and the item used to fill it.
+     */
+    RenderQueue *renderQueue;
+    RenderItem item;
+    /** \brief The ring buffer the frame data and the instance
+     *  matrices are written into, and the frame block itself.
+     */
+    RingBuffer *frameRing;
+    FrameData frame;
+    //! The lists of the lights that reach each cluster of the view.
+    LightClusters *lightClusters;
+    //! Print the render queue counters.
+    bool showStats = false;
     //! Dice positions
     vector<vec3>dicepos;
     //! Mouse pointer positions.
@@ -187,9 +234,19 @@ protected:
     //! Temporary transformation matrix for the walls and floor.
     mat4 tilemodel = mat4(1.0f);
     //! Shader class to create and manage shaders.
-    Shader *stageShader, *shader, *skyBoxShader;
+    Shader *stageShader, *skyBoxShader;
+    //! The dice shader, a variant for each combination of material features.
+    ShaderSet *diceShaders;
     //! Image class to change images to textures.
     CreateImage *image;
+    //! Streams the texture levels in through pixel buffers.
+    TextureStreamer *streamer;
+    /** \brief The packed resources, made with resourcepacker.  When
+     *  it is installed the shaders, images, meshes and sound come
+     *  out of it, otherwise from the files named here.
+     */
+    ResourceArchive *archive;
+    string archiveName = "/usr/share/openglresources/openglresources.pak";
     /**! Camera class to manage camera position and 
      *  orientation.
      */
@@ -56,6 +56,8 @@
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <thread>
+#include <atomic>
 
 /** \brief  This project is include in the assimpopengl directory and
  * will be compile and installed with the rest of the project.
@@ -95,6 +97,8 @@ struct PointLight {
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;
+    //! How far the light reaches, 0 when it reaches everything.
+    float range = 0.0f;
 };
 /** \breif A structure to define a spotlight.
  */
@@ -111,6 +115,8 @@ struct SpotLight {
     vec3 ambient;
     vec3 diffuse;
     vec3 specular;       
+    //! How far the light reaches, 0 when it reaches everything.
+    float range = 0.0f;
 };
 
 #endif // COMMONHEADER_H
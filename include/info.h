@@ -30,7 +30,8 @@ struct ModelInfo {
     vector<MeshInfo> meshes;
     mat4 model;
     vec3 location;
-    int dist = 0;
+    //! The distance from the camera, for the draw order and the levels of detail.
+    float dist = 0.0f;
     int idval = 0;
 };
 
@@ -30,49 +30,90 @@ out vec4 color;
 
 struct PointLight {    
     vec3 position;
-    
     float constant;
-    float linear;
-    float quadratic;  
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
+    float range;
 };  
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-  
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;       
+    float range;
+};
+
+//! The per frame data, the std140 layout matches FrameData in ringbuffer.h.
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLights[NR_SPOT_LIGHTS];
+};
+
+#ifdef CLUSTERED_LIGHTS
+//! The cluster grid and the light block sizes, as in lightclusters.h.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_INDEX_WIDTH 1024u
+#define CLUSTER_POINT_LIGHTS 64
+#define CLUSTER_SPOT_LIGHTS 32
+//! The lights of the clusters, the std140 layout matches LightBlock in lightclusters.h.
+layout (std140) uniform LightData
+{
+    //! The viewport size, the near plane and the depth slices per unit of log depth.
+    vec4 clusterScale;
+    PointLight clusterPoints[CLUSTER_POINT_LIGHTS];
+    SpotLight clusterSpots[CLUSTER_SPOT_LIGHTS];
 };
+//! Per cluster:  its first light index, its point light and its spot light counts.
+uniform highp usampler2D clusterGrid;
+//! The light indices of all the clusters, row after row.
+uniform highp usampler2D lightIndices;
+#endif
 
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLights[NR_SPOT_LIGHTS];
 uniform samplerCube SkyBox;
-uniform vec3 viewPos;
-//! Texture (optional)
+/** The textures are chosen when the shader is compiled, the
+ *  Shader class puts these defines after the version line:
+ *  HAS_DIFFUSE_MAP, HAS_SPECULAR_MAP, HAS_NORMAL_MAP, DIFF_ONLY,
+ *  PACKED_VERTICES, DRAW_DATA and CLUSTERED_LIGHTS.
+ */
+#ifdef HAS_DIFFUSE_MAP
 uniform sampler2D texture_diffuse1;
+#endif
+#ifdef HAS_SPECULAR_MAP
 uniform sampler2D texture_specular1;
+#endif
+#ifdef HAS_NORMAL_MAP
 uniform sampler2D texture_binormal1;
+#endif
+#ifdef DRAW_DATA
+//! From the per draw data of a multi draw, in place of the uniforms.
+flat in vec4 drawColor;
+flat in float drawShininess;
+#define shininess drawShininess
+#define opacity drawColor.a
+#define colordiff drawColor.rgb
+#else
 //! Specular intensity
 uniform float shininess;
-//! Toggle for texture
-uniform bool isDiffuse;
-uniform bool isSpecular;
-uniform bool isBiNormal;
-uniform bool diffOnly;
 //! Object transparency
 uniform float opacity;
 uniform vec3 colordiff;
+#endif
 
 //! Shader variables
 vec3 skyLight;
@@ -87,41 +128,77 @@ vec3 CalcDirLight(vec3 light, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 viewDir);
 
-SpotLight spotter;
-void main()
+#ifdef CLUSTERED_LIGHTS
+//! The texel of the cluster grid the fragment falls in.
+ivec2 clusterCell()
 {
-    if (isBiNormal)
-    {
-        // obtain normal from normal map in range [0,1]
-        normal = texture(texture_binormal1, locval.TexCoord).rgb;
-        // transform normal vector to range [-1,1]
-        normal = normalize(normal * 2.0 - 1.0);  // this normal is in tangent space
-    }
-    else
-    {
-        normal = normalize(locval.Normal);
-    }
-    if (isDiffuse)
-    {
-        texVal = texture(texture_diffuse1, locval.TexCoord);
-    }
-    else
-    {
-        texVal = vec4(colordiff, opacity);
-    }
-    if (isSpecular)
-    {
-        specVal = texture(texture_specular1, locval.TexCoord);
-    }
-    else
+    vec2 tile = gl_FragCoord.xy / clusterScale.xy * vec2(CLUSTER_X, CLUSTER_Y);
+    float depth = max(-(view * vec4(locval.Position, 1.0)).z, clusterScale.z);
+    float slice = log(depth / clusterScale.z) * clusterScale.w;
+    ivec3 cell = clamp(ivec3(tile, slice), ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+    return ivec2(cell.x + cell.y * CLUSTER_X, cell.z);
+}
+
+//! The light index at a place in the index list.
+uint lightIndex(uint at)
+{
+    return texelFetch(lightIndices, ivec2(at % CLUSTER_INDEX_WIDTH, at / CLUSTER_INDEX_WIDTH), 0).r;
+}
+#endif
+
+//! Fades a light out at the edge of its range, so the cluster edges do not show.
+float rangeFade(float distance, float range)
+{
+    if (range <= 0.0)
     {
-        specVal = vec4(colordiff, opacity);
+        return 1.0;
     }
+    float fade = clamp(1.0 - pow(distance / range, 4.0), 0.0, 1.0);
+    return fade * fade;
+}
+
+SpotLight spotter;
+void main()
+{
+#ifdef HAS_NORMAL_MAP
+    // obtain normal from normal map in range [0,1]
+    normal = texture(texture_binormal1, locval.TexCoord).rgb;
+    // transform normal vector to range [-1,1], this normal is in tangent space
+    normal = normalize(normal * 2.0 - 1.0);
+    //! The BiNormal attribute carries the tangent, the bitangent is made here.
+    vec3 N = normalize(locval.Normal);
+    vec3 T = normalize(locval.BiNormal - dot(locval.BiNormal, N) * N);
+    normal = normalize(mat3(T, cross(N, T), N) * normal);
+#else
+    normal = normalize(locval.Normal);
+#endif
+#ifdef HAS_DIFFUSE_MAP
+    texVal = texture(texture_diffuse1, locval.TexCoord);
+#else
+    texVal = vec4(colordiff, opacity);
+#endif
+#ifdef HAS_SPECULAR_MAP
+    specVal = texture(texture_specular1, locval.TexCoord);
+#else
+    specVal = vec4(colordiff, opacity);
+#endif
     //! \brief Vector describing direction from camera to object.
     vec3 I = -normalize(viewPos - locval.Position);
     vec3 R = reflect(I, normal);
     skyLight = vec4(texture(SkyBox, R)).xyz;
     color = vec4(CalcDirLight(skyLight, I), opacity);
+#ifdef CLUSTERED_LIGHTS
+    //! Only the lights that reach the fragment's cluster, spot lights after the point lights in the list.
+    uvec4 cell = texelFetch(clusterGrid, clusterCell(), 0);
+    for (uint x = 0u; x < cell.z; x++)
+    {
+        color += vec4(CalcSpotLight(clusterSpots[lightIndex(cell.x + cell.y + x)], I), opacity);
+    }
+    for (uint i = 0u; i < cell.y; i++)
+    {
+        color += vec4(CalcPointLight(clusterPoints[lightIndex(cell.x + i)], I), opacity);
+    }
+#else
     for (int x = 0; x < NR_SPOT_LIGHTS; x++)
     {
         color += vec4(CalcSpotLight(spotLights[x], I), opacity);
@@ -130,6 +207,7 @@ void main()
     {
         color += vec4(CalcPointLight(pointLights[i], I), opacity);
     }
+#endif
     //! Debug stuff
     /*
     if (isDiffuse)
@@ -156,14 +234,11 @@ vec3 CalcDirLight(vec3 light, vec3 viewDir)
     vec3 ambient  = 0.2 * texVal.xyz;
     vec3 diffuse  = 1.4 * diff * texVal.xyz;
     vec3 specular = spec * specVal.xyz;
-    if (diffOnly)
-    {
-        return (ambient + diffuse);
-    }
-    else
-    {
-        return vec3(ambient + diffuse + specular);
-    }
+#ifdef DIFF_ONLY
+    return (ambient + diffuse);
+#else
+    return vec3(ambient + diffuse + specular);
+#endif
 } 
 
 // calculates the color when using a point light.
@@ -182,18 +257,15 @@ vec3 CalcPointLight(PointLight light, vec3 viewDir)
     vec3 ambient = light.ambient * texVal.xyz;
     vec3 diffuse = light.diffuse * diff * texVal.xyz;
     vec3 specular = light.specular * spec * specVal.xyz;
-    float attenuation = 0.9;
+    float attenuation = 0.9 * rangeFade(distance, light.range);
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
-    if (diffOnly)
-    {
-        return (ambient + diffuse);
-    }
-    else
-    {
-        return vec3(ambient + diffuse + specular);
-    }
+#ifdef DIFF_ONLY
+    return (ambient + diffuse);
+#else
+    return vec3(ambient + diffuse + specular);
+#endif
 }
 
 // calculates the color when using a spot light.
@@ -213,7 +285,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     //float intensity = 1.0;
-    float attenuation = 0.9;
+    float attenuation = 0.9 * rangeFade(distance, light.range);
     // combine results
     vec3 ambient = light.ambient * texVal.xyz;
     vec3 diffuse = light.diffuse * diff * texVal.xyz;
@@ -221,12 +293,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 viewDir)
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
-    if (diffOnly)
-    {
-        return (ambient + diffuse);
-    }
-    else
-    {
-        return vec3(ambient + diffuse + specular);
-    }
+#ifdef DIFF_ONLY
+    return (ambient + diffuse);
+#else
+    return vec3(ambient + diffuse + specular);
+#endif
 }
@@ -11,10 +11,79 @@
 
 #version 300 es
 precision highp float;
+
+#define NR_POINT_LIGHTS 6
+#define NR_SPOT_LIGHTS 3
+
+struct PointLight {    
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float range;
+};  
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+    float range;
+};
+
+//! The per frame data, the std140 layout matches FrameData in ringbuffer.h.
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLights[NR_SPOT_LIGHTS];
+};
+
+#ifdef PACKED_VERTICES
+//! Normalized within the mesh bounds, the directions octahedral, see PackedVertex.
+layout (location = 0) in vec3 packedPosition;
+layout (location = 1) in vec2 packedNormal;
+layout (location = 2) in vec2 packedBinormal;
+layout (location = 3) in vec2 packedTexCoord;
+#ifndef DRAW_DATA
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 uvOffset;
+uniform vec2 uvScale;
+#endif
+#else
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec3 binormal;
 layout (location = 3) in vec2 texCoord;
+#endif
+//! Model matrix per instance, when drawn instanced.
+layout (location = 4) in mat4 instanceModel;
+#ifdef DRAW_DATA
+//! The rest of the per draw data of a multi draw, see DrawData in renderqueue.h.
+layout (location = 8) in vec4 drawMaterial;
+layout (location = 9) in vec4 drawPositionOffset;
+layout (location = 10) in vec4 drawPositionScale;
+layout (location = 11) in vec4 drawUVTransform;
+#define positionOffset drawPositionOffset.xyz
+#define positionScale drawPositionScale.xyz
+#define uvOffset drawUVTransform.xy
+#define uvScale drawUVTransform.zw
+//! The color, opacity and shininess for the fragment shader.
+flat out vec4 drawColor;
+flat out float drawShininess;
+#endif
 
 struct Location
 {
@@ -26,14 +95,39 @@ struct Location
 out Location locval;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform bool instanced;
+
+#ifdef PACKED_VERTICES
+//! Unfold an octahedral direction, the reverse of Mesh::packDirection().
+vec3 octDecode(vec2 oct)
+{
+    vec3 dir = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+    if (dir.z < 0.0)
+    {
+        dir.xy = (1.0 - abs(dir.yx)) * vec2(dir.x >= 0.0 ? 1.0 : -1.0, dir.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(dir);
+}
+#endif
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f);
-    locval.Normal = vec4(model * vec4(normal, 1.0)).xyz;
-    locval.Position = vec4(model * vec4(position, 1.0f)).xyz;
+#ifdef PACKED_VERTICES
+    vec3 position = positionOffset + packedPosition * positionScale;
+    vec3 normal = octDecode(packedNormal);
+    vec3 binormal = octDecode(packedBinormal);
+    vec2 texCoord = uvOffset + packedTexCoord * uvScale;
+#endif
+#ifdef DRAW_DATA
+    mat4 world = instanceModel;
+    drawColor = drawMaterial;
+    drawShininess = drawPositionOffset.w;
+#else
+    mat4 world = instanced ? instanceModel : model;
+#endif
+    gl_Position = projection * view * world * vec4(position, 1.0f);
+    locval.Normal = vec4(world * vec4(normal, 1.0)).xyz;
+    locval.Position = vec4(world * vec4(position, 1.0f)).xyz;
     locval.TexCoord = texCoord;
-    locval.BiNormal = vec4(model * vec4(binormal, 1.0)).xyz;
+    locval.BiNormal = vec4(world * vec4(binormal, 1.0)).xyz;
 } 
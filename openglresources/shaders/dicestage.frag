@@ -32,35 +32,62 @@ out vec4 color;
 
 struct PointLight {    
     vec3 position;
-    
     float constant;
-    float linear;
-    float quadratic;  
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
+    float range;
 };  
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-  
+    vec3 ambient;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;       
+    float range;
+};
+
+//! The per frame data, the std140 layout matches FrameData in ringbuffer.h.
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLights[NR_SPOT_LIGHTS];
+};
+
+#ifdef CLUSTERED_LIGHTS
+//! The cluster grid and the light block sizes, as in lightclusters.h.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_INDEX_WIDTH 1024u
+#define CLUSTER_POINT_LIGHTS 64
+#define CLUSTER_SPOT_LIGHTS 32
+//! The lights of the clusters, the std140 layout matches LightBlock in lightclusters.h.
+layout (std140) uniform LightData
+{
+    //! The viewport size, the near plane and the depth slices per unit of log depth.
+    vec4 clusterScale;
+    PointLight clusterPoints[CLUSTER_POINT_LIGHTS];
+    SpotLight clusterSpots[CLUSTER_SPOT_LIGHTS];
 };
+//! Per cluster:  its first light index, its point light and its spot light counts.
+uniform highp usampler2D clusterGrid;
+//! The light indices of all the clusters, row after row.
+uniform highp usampler2D lightIndices;
+#endif
 
-uniform SpotLight spotLights[NR_SPOT_LIGHTS];
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 
-uniform vec3 viewPos;
 //! Texture (optional)
 uniform highp sampler2DArray wallTex;
 
@@ -76,6 +103,35 @@ vec3 CalcDirLight(vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 viewDir);
 
+#ifdef CLUSTERED_LIGHTS
+//! The texel of the cluster grid the fragment falls in.
+ivec2 clusterCell()
+{
+    vec2 tile = gl_FragCoord.xy / clusterScale.xy * vec2(CLUSTER_X, CLUSTER_Y);
+    float depth = max(-(view * vec4(locval.Position, 1.0)).z, clusterScale.z);
+    float slice = log(depth / clusterScale.z) * clusterScale.w;
+    ivec3 cell = clamp(ivec3(tile, slice), ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+    return ivec2(cell.x + cell.y * CLUSTER_X, cell.z);
+}
+
+//! The light index at a place in the index list.
+uint lightIndex(uint at)
+{
+    return texelFetch(lightIndices, ivec2(at % CLUSTER_INDEX_WIDTH, at / CLUSTER_INDEX_WIDTH), 0).r;
+}
+#endif
+
+//! Fades a light out at the edge of its range, so the cluster edges do not show.
+float rangeFade(float distance, float range)
+{
+    if (range <= 0.0)
+    {
+        return 1.0;
+    }
+    float fade = clamp(1.0 - pow(distance / range, 4.0), 0.0, 1.0);
+    return fade * fade;
+}
+
 SpotLight spotter;
 void main()
 {
@@ -87,6 +143,19 @@ void main()
     vec3 I = -normalize(viewPos - locval.Position);
 
     color = vec4(CalcDirLight(I), 1.0);
+#ifdef CLUSTERED_LIGHTS
+    //! Only the lights that reach the fragment's cluster, spot lights after the point lights in the list.
+    uvec4 cell = texelFetch(clusterGrid, clusterCell(), 0);
+    for (uint x = 0u; x < cell.z; x++)
+    {
+        color += vec4(CalcSpotLight(clusterSpots[lightIndex(cell.x + cell.y + x)], I), 1.0);
+    }
+    // phase 2: point lights
+    for (uint i = 0u; i < cell.y; i++)
+    {
+        color += vec4(CalcPointLight(clusterPoints[lightIndex(cell.x + i)], I), 1.0);
+    }
+#else
     for (int x = 0; x < NR_SPOT_LIGHTS; x++)
     {
         color += vec4(CalcSpotLight(spotLights[x], I), 1.0);
@@ -96,6 +165,7 @@ void main()
     {
         color += vec4(CalcPointLight(pointLights[i], I), 1.0);
     }
+#endif
 
     //! Debug stuff
     //color = texVal;
@@ -122,6 +192,7 @@ vec3 CalcPointLight(PointLight light, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float distance = length(light.position - locval.Position);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    attenuation *= rangeFade(distance, light.range);
     // combine results
     vec3 ambient = light.ambient * texVal.xyz;
     vec3 diffuse = light.diffuse * diff * texVal.xyz;
@@ -145,7 +216,7 @@ vec3 CalcSpotLight(SpotLight light, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     //float intensity = 1.0;
-    float attenuation = 0.9;
+    float attenuation = 0.9 * rangeFade(distance, light.range);
     // combine results
     vec3 ambient = light.ambient * texVal.xyz;
     vec3 diffuse = light.diffuse * diff * texVal.xyz;
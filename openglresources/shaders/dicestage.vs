@@ -15,6 +15,44 @@
 
 precision highp float;
 
+#define NR_POINT_LIGHTS 6
+#define NR_SPOT_LIGHTS 3
+
+struct PointLight {    
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float range;
+};  
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+    float range;
+};
+
+//! The per frame data, the std140 layout matches FrameData in ringbuffer.h.
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLights[NR_SPOT_LIGHTS];
+};
+
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec3 binormal;
@@ -30,8 +68,6 @@ struct Location
 };
 out Location locval;
 
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
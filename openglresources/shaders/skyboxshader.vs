@@ -7,20 +7,59 @@
  * ********************************************************/
 #version 300 es
 precision highp float;
+
+#define NR_POINT_LIGHTS 6
+#define NR_SPOT_LIGHTS 3
+
+struct PointLight {    
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+    float range;
+};  
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+    float range;
+};
+
+//! The per frame data, the std140 layout matches FrameData in ringbuffer.h.
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLights[NR_SPOT_LIGHTS];
+};
+
 layout (location = 0) in vec3 position;
 
 out vec3 textureDir;
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 
 vec4 tmpvec;
 
 void main()
 {
-      
-    gl_Position = projection * view * model * vec4(position, 1.0);
+    //! Rotation only, the sky does not move with the camera.
+    mat4 skyView = mat4(mat3(view));
     tmpvec = model * vec4(position, 1.0);
+    //! z = w puts the sky at the far plane after the divide.
+    gl_Position = (projection * skyView * tmpvec).xyww;
     textureDir = tmpvec.xyz;
 }  
@@ -33,7 +33,18 @@ BulletDiceGL::BulletDiceGL()
     {
         cout << "\n\n\tInitialized SDL.\n\n";
     }
+    //! Mounted before the sound thread starts, it reads from the archive too.
+    archive = new ResourceArchive();
+    if (archive->open(archiveName))
+    {
+        ResourceArchive::mount(archive);
+    }
+    else
+    {
+        cout << "\n\n\tNo resource archive, loading the resource files.\n\n";
+    }
     image = new CreateImage();
+    renderQueue = new RenderQueue(10000.0f);
     srand(time(nullptr));
     int i, count = SDL_GetNumAudioDevices(0);
 
@@ -130,12 +141,24 @@ BulletDiceGL::BulletDiceGL()
         }
         //glCullFace(GL_BACK);
         glDepthRange(0.1f, 10000.0f);
-        shader = new Shader();
-        shader->initShader("/usr/share/openglresources/shaders/bulletshader.vs", 
-        "/usr/share/openglresources/shaders/bulletshader.frag", "bulletshader.bin");
+        /** The programs are started here and compile while the models
+         *  and textures load, they are waited for in setupShaders().
+         *  The dice variants are started once the model is built, before its uploads.
+         */
+        diceShaders = new ShaderSet("/usr/share/openglresources/shaders/bulletshader.vs", 
+        "/usr/share/openglresources/shaders/bulletshader.frag", "bulletshader");
         stageShader = new Shader();
-        stageShader->initShader("/usr/share/openglresources/shaders/dicestage.vs", 
-        "/usr/share/openglresources/shaders/dicestage.frag", "dicestage.bin");
+        stageShader->beginShader("/usr/share/openglresources/shaders/dicestage.vs", 
+        "/usr/share/openglresources/shaders/dicestage.frag", "dicestage_clustered.bin",
+        ShaderSet::defines(FEATURE_CLUSTERED_LIGHTS));
+        skyBoxShader = new Shader();
+        skyBoxShader->beginShader(string("/usr/share/openglresources/shaders/skyboxshader.vs"),
+        string("/usr/share/openglresources/shaders/skyboxshader.frag"), string("skyboxshader.bin"));
+        frameRing = new RingBuffer();
+        lightClusters = new LightClusters();
+        //! The textures are drawn at low resolution until their full levels arrive.
+        streamer = new TextureStreamer();
+        image->setStreamer(streamer);
         camera = new Camera(SCR_WIDTH, SCR_HEIGHT, initPos, vec3(0.0f, 0.0f, 0.0f));
     }
     catch(exception exc)
@@ -143,6 +166,9 @@ BulletDiceGL::BulletDiceGL()
         cout << "\n\n\tProgram Initialization Error:  " << exc.what() << "\n\n";
     }
     cout << "\n\n\tCreating point lights.\n\n";
+    //! The lights are culled to the clusters they reach.
+    lightItem.range = LIGHT_RANGE;
+    spotItem.range = LIGHT_RANGE;
     // point light 1
     lightItem.position = pointLightPositions[0];
     lightItem.ambient = vec3(0.05f, 0.05f, 0.05f);
@@ -269,8 +295,8 @@ BulletDiceGL::BulletDiceGL()
             lwallPos[count++] = quadModel;
         }
     }  
-    setupObjects();
-    createSkyBox();
+    loadAssets();
+    setupShaders();
     execLoop();
     SDL_WaitThread(thread, &threadReturnValue);
     cout << "\n\n\tThread returned value:  " << threadReturnValue << "\n\n";
@@ -283,9 +309,14 @@ BulletDiceGL::~BulletDiceGL()
      *  from the object deleted.
      */
     delete camera;
-    delete shader;
+    delete diceShaders;
     delete skyBoxShader;
     delete model;
+    delete renderQueue;
+    delete frameRing;
+    delete lightClusters;
+    delete streamer;
+    delete archive;
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteBuffers(1, &skyboxVBO);
     glDeleteTextures(1, &skyBox);
@@ -295,6 +326,110 @@ BulletDiceGL::~BulletDiceGL()
     exit(0);
 }
 
+/** The files are read, the meshes built and the images decoded
+ *  on a thread of their own, the window is drawn and its events
+ *  handled meanwhile.  The GL uploads are left for this thread,
+ *  a slice of them each frame.
+ */
+void BulletDiceGL::loadAssets()
+{
+    auto start = chrono::system_clock::now();
+    loadStage = 0;
+    loadDone = false;
+    std::thread loader(&BulletDiceGL::loadWorker, this);
+    while (!loadDone)
+    {
+        loadEvents();
+        drawProgress(0.5f * (float) loadStage / (float) LOAD_STAGES);
+        SDL_Delay(10);
+    }
+    loader.join();
+    auto decoded = chrono::system_clock::now();
+    //! The dice are drawn from per draw data, joined into multi draws where GL has them.
+    model->setMultiDraw(true);
+    /** Start the dice shader variants before the uploads, so they
+     *  compile meanwhile.  The layout of each mesh was fixed when it
+     *  was built, see Mesh::setPacking().
+     */
+    model->selectPrograms(diceShaders, true, FEATURE_CLUSTERED_LIGHTS);
+    //! Closing the window finishes the uploads at once, so the model is whole when it is deleted.
+    while (!model->finishLoading(quit ? 0.0 : LOAD_FRAME_BUDGET))
+    {
+        loadEvents();
+        drawProgress(0.5f + 0.4f * model->uploadProgress());
+    }
+    drawProgress(0.9f);
+    createSkyBox();
+    image->create2DTexArray(wallTex, feltLayers);
+    feltLayers.clear();
+    uploadQuad();
+    drawProgress(1.0f);
+    auto finish = chrono::system_clock::now();
+    cout << "\n\n\tLoaded the assets in " << chrono::duration_cast<chrono::milliseconds>(finish - start).count()
+    << " ms, " << chrono::duration_cast<chrono::milliseconds>(finish - decoded).count() 
+    << " ms of it uploading.\n\n";
+}
+
+void BulletDiceGL::loadWorker()
+{
+    setupObjects();
+    loadStage = 1;
+    skyFaces.resize(6);
+    for (int i = 0; i < 6; i++)
+    {
+        skyFaces[i].path = skyBoxNames[i];
+    }
+    CreateImage::decodeAll(skyFaces);
+    loadStage = 2;
+    for (int x = 0; x < 3; x++)
+    {
+        tileNames.push_back(feltNames[x]);
+        feltLayers.push_back(DecodedImage());
+        feltLayers.back().path = feltNames[x];
+    }
+    CreateImage::decodeAll(feltLayers);
+    loadStage = 3;
+    calcQuad();
+    loadStage = LOAD_STAGES;
+    loadDone = true;
+}
+
+//! Only the window events, the keys and the mouse wait for the dice.
+void BulletDiceGL::loadEvents()
+{
+    SDL_Event e;
+    while (SDL_PollEvent(&e))
+    {
+        windowEvent(e);
+    }
+}
+
+//! A bar across the middle of the window, cleared in with the scissor.
+void BulletDiceGL::drawProgress(float fraction)
+{
+    if ((width == 0) || (height == 0))
+    {
+        return;
+    }
+    GLint barWidth = (width * 3) / 5;
+    GLint barHeight = std::max((GLint) height / 40, 4);
+    GLint left = (width - barWidth) / 2;
+    GLint bottom = (height - barHeight) / 2;
+    fraction = glm::clamp(fraction, 0.0f, 1.0f);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(left, bottom, barWidth, barHeight);
+    glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glScissor(left, bottom, (GLsizei) (barWidth * fraction), barHeight);
+    glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+    SDL_GL_SwapWindow(window);
+}
+
+//! Runs on the loading thread, so nothing here may use the GL context.
 void BulletDiceGL::setupObjects()
 {
     /** Here is where the Blender object file name and
@@ -328,13 +463,12 @@ void BulletDiceGL::setupObjects()
         item.model = vertmodel;
         cout << "\n\n\tStoring item:  " <<  item.path << "  Index:  " << 1 << ".\n\n";
         modelinfo.push_back(item);
-        model = new Model(modelinfo);
-        calcQuad();
-        for (int x = 0; x < 3; x++)
-        {
-            tileNames.push_back(feltNames[x]);
-        }
-        image->create2DTexArray(wallTex, tileNames);
+        //! The dice are drawn through their shader variants, so their vertices can be packed.
+        Mesh::setPacking(true);
+        /** The dice are drawn diffuse only, so their specular maps are
+         *  not loaded.  The model is deferred, loadAssets() uploads it.
+         */
+        model = new Model(modelinfo, streamer, ShaderSet::sampledMaps(true), nullptr, true);
     }
     catch(exception exc)
     {
@@ -344,12 +478,8 @@ void BulletDiceGL::setupObjects()
 
 void BulletDiceGL::createSkyBox()
 {
-    skyBoxShader = new Shader();
-    skyBoxShader->initShader(string("/usr/share/openglresources/shaders/skyboxshader.vs"),
-    string("/usr/share/openglresources/shaders/skyboxshader.frag"), string("skyboxshader.bin"));
-
-    glGenTextures(1, &skyBox);
-    image->createSkyBoxTex(skyBox, skyBoxNames);
+    image->createSkyBoxTex(skyBox, skyFaces);
+    skyFaces.clear();
 
     cout << "\n\n\tCreating skybox vertex buffer.\n\n";
     // Generate the sky box.
@@ -365,10 +495,37 @@ void BulletDiceGL::createSkyBox()
 }    
 
 
+void BulletDiceGL::setupShaders()
+{
+    //! The first use of each program waits for its compile to finish.
+    auto start = chrono::system_clock::now();
+    //! The camera and the lights come from the frame block.
+    stageShader->bindBlock("FrameData", FRAME_BLOCK_BINDING);
+    skyBoxShader->bindBlock("FrameData", FRAME_BLOCK_BINDING);
+    //! The dice and the stage are lit from the cluster lists.
+    LightClusters::setupShader(stageShader);
+    //! The samplers never change, so they are set once here.
+    vector<Shader*> variants = diceShaders->getShaders();
+    for (int x = 0; x < variants.size(); x++)
+    {
+        variants[x]->bindBlock("FrameData", FRAME_BLOCK_BINDING);
+        LightClusters::setupShader(variants[x]);
+        variants[x]->Use();
+        variants[x]->setInt("SkyBox", 2);
+    }
+    stageShader->Use();
+    stageShader->setInt("wallTex", 1);
+    skyBoxShader->Use();
+    skyBoxShader->setInt("skybox", 0);
+    auto finish = chrono::system_clock::now();
+    cout << "\n\n\tWaited " << chrono::duration_cast<chrono::milliseconds>(finish - start).count()
+    << " ms for the shader programs.\n\n";
+}
+
 void BulletDiceGL::execLoop()
 {
     int count = 0;
-    quit = false;
+    //! The window may have been closed while loading.
     SDL_Event e;
     diceRoller = new DiceRoll(initPos);
     diceRoller->resetDice();
@@ -394,6 +551,8 @@ void BulletDiceGL::execLoop()
         // ------
         glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        //! Land the texture levels that finished and start the next ones.
+        streamer->update();
         //! Tell the position class DiceRoller where the camera is.
         if (debug1)
         {
@@ -408,62 +567,54 @@ void BulletDiceGL::execLoop()
         //! Set the viewport and draw the graphic objects. 
         view = camera->getViewMatrix(); //! render
         projection = camera->getPerspective();
-        skyBoxShader->Use();
-        skyBoxShader->setMat4("view", view);
-        skyBoxShader->setMat4("projection", projection);
-        skyBoxShader->setMat4("model", boxmodel);
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
+        //! The dice far from the camera are drawn from their coarser levels.
+        model->setLodProjection(projection, height);
+        /** The camera and the light definitions are written once into
+         *  the ring buffer, all three programs read the same block.
+         */
+        frameRing->beginFrame();
+        RingBuffer::fillFrameData(frame, view, projection, viewPos, lights, spotLights);
+        GLintptr frameOffset = frameRing->writeUniform(&frame, sizeof(FrameData));
+        //! Each light is listed in the clusters its range reaches, the lists stay bound for the frame.
+        lightClusters->update(view, projection, width, height, lights, spotLights);
+        GLintptr lightOffset = lightClusters->writeBlock(frameRing);
+        //! The dice reflect the sky box, it stays on unit 2 for the frame.
+        glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_CUBE_MAP, skyBox);
-        skyBoxShader->setInt("skybox", 0);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-        glBindVertexArray(0);
-        glBindVertexArray(VAO);
-        stageShader->Use();
-        //! Pass into the shader the light definitions.
-        stageShader->setMat4("view", view);
-        stageShader->setMat4("projection", projection);
-        stageShader->setVec3("viewPos", viewPos);
-        for (int x = 0; x < lights.size(); x++)
-        {   
-            stringstream ss;
-            ss << x;
-            stageShader->setVec3("pointLights[" + ss.str() + "].position", lights[x].position);
-            stageShader->setVec3("pointLights[" + ss.str() + "].ambient", lights[x].ambient);
-            stageShader->setVec3("pointLights[" + ss.str() + "].diffuse", lights[x].diffuse);
-            stageShader->setVec3("pointLights[" + ss.str() + "].specular", lights[x].specular);
-            stageShader->setFloat("pointLights[" + ss.str() + "].constant", lights[x].constant);
-            stageShader->setFloat("pointLights[" + ss.str() + "].linear", lights[x].linear);
-            stageShader->setFloat("pointLights[" + ss.str() + "].quadratic", lights[x].quadratic);
-        }
-        for (int x = 0; x < spotLights.size(); x++)
-        {   
-            stringstream ss;
-            ss << x;
-            stageShader->setVec3("spotLights[" + ss.str() + "].position", spotLights[x].position);
-            stageShader->setVec3("spotLights[" + ss.str() + "].direction", spotLights[x].direction);
-            stageShader->setFloat("spotLights[" + ss.str() + "].cutOff", spotLights[x].cutOff);
-            stageShader->setFloat("spotLights[" + ss.str() + "].outerCutOff", spotLights[x].outerCutOff);
-            stageShader->setVec3("spotLights[" + ss.str() + "].ambient", spotLights[x].ambient);
-            stageShader->setVec3("spotLights[" + ss.str() + "].diffuse", spotLights[x].diffuse);
-            stageShader->setVec3("spotLights[" + ss.str() + "].specular", spotLights[x].specular);
-            stageShader->setFloat("spotLights[" + ss.str() + "].constant", spotLights[x].constant);
-            stageShader->setFloat("spotLights[" + ss.str() + "].linear", spotLights[x].linear);
-            stageShader->setFloat("spotLights[" + ss.str() + "].quadratic", spotLights[x].quadratic);
+        //! Queue the sky box, the walls and floor and the dice, the queue draws the sky after the opaque pass.
+        renderQueue->clear();
+        item = RenderItem();
+        item.pass = PASS_SKY;
+        item.shader = skyBoxShader;
+        item.vao = skyboxVAO;
+        item.textures[0] = {GL_TEXTURE_CUBE_MAP, skyBox, 0};
+        item.texCount = 1;
+        item.model = &boxmodel;
+        item.count = 36;
+        renderQueue->add(item);
+        item = RenderItem();
+        item.pass = PASS_OPAQUE;
+        item.shader = stageShader;
+        item.vao = VAO;
+        item.textures[0] = {GL_TEXTURE_2D_ARRAY, wallTex, 1};
+        item.texCount = 1;
+        item.count = 3 * 6 * TILES;
+        renderQueue->add(item);
+        model->enqueue(renderQueue, frameRing, nullptr, modelinfo, viewPos, 3, true);
+        frameRing->flush();
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameRing->getBuffer(), 
+        frameOffset, sizeof(FrameData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, frameRing->getBuffer(), 
+        lightOffset, sizeof(LightBlock));
+        renderQueue->submit();
+        frameRing->endFrame();
+        if (showStats)
+        {
+            renderQueue->printStats();
+            lightClusters->printStats();
+            showStats = false;
         }
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, wallTex);
-        stageShader->setInt("wallTex", 1);
-        glDrawArrays(GL_TRIANGLES, 0, 3 * 6 * TILES);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
-        glBindVertexArray(0);
-        // Draw the dice.
-        shader->Use();
         glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyBox);
-        skyBoxShader->setInt("SkyBox", 2);
-        model->Draw(shader, view, projection, modelinfo, lights, spotLights, viewPos, 3, true);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
         intend = chrono::system_clock::now();
         //! Get the DiceRoller adjusted camera position.
@@ -577,6 +728,15 @@ void BulletDiceGL::keyDown(SDL_Event e)
             case SDLK_p:
                 pause = !pause;
                 break;
+            //! Print the render queue counters for the next frame.
+            case SDLK_i:
+                showStats = true;
+                renderQueue->measureSkyOnce();
+                break;
+            //! Draw the sky before or after the opaque pass, to compare with i.
+            case SDLK_k:
+                renderQueue->setSkyFirst(!renderQueue->getSkyFirst());
+                break;
             //! Zoom keys.
             //! Zoom in.
             case SDLK_UP:
@@ -731,7 +891,18 @@ void BulletDiceGL::sndMaker()
     cout << "\n\n\tStarting sound production.";
     cout << "\n\tLoading WAV file.\n\n";
     
-    if (SDL_LoadWAV("/usr/share/openglresources/sound/celticfive.wav", &wave_spec, &wave_buf, &wave_len) ==  NULL)
+    string soundFile = "/usr/share/openglresources/sound/celticfive.wav";
+    ResourceView view;
+    SDL_AudioSpec *loaded;
+    if (ResourceArchive::findMounted(soundFile, RESOURCE_RAW, view))
+    {
+        loaded = SDL_LoadWAV_RW(SDL_RWFromConstMem(view.data, view.size), 1, &wave_spec, &wave_buf, &wave_len);
+    }
+    else
+    {
+        loaded = SDL_LoadWAV(soundFile.c_str(), &wave_spec, &wave_buf, &wave_len);
+    }
+    if (loaded ==  NULL)
     {
         cout << "\n\n\tUnable to load WAV file:  " << SDL_GetError() << "\n\n";
         exit(-1);
@@ -961,11 +1132,9 @@ vec3 BulletDiceGL::calcAngles(vec3 rotation, float y, vec3 angle, int index)
 }    
 void BulletDiceGL::calcQuad()
 {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
     vec3 pos[2][4];
     int count = 0, vertCount = 0;
-    float cornerVerts[TILES * 3 * 6 * 11];
+    cornerVerts.resize(TILES * 3 * 6 * 11);
     Vertex point;
     //! Floorquad
     pos[0][0] = vec3(0.0f, 0.0f, 4.0f);
@@ -1149,19 +1318,6 @@ void BulletDiceGL::calcQuad()
             printVec2(vertices[x].TexCoord);
         }
     }
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cornerVerts), cornerVerts, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(9 * sizeof(float)));
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
     if (debug1)
     {
         cout << "\n\n\tFloor Quad\n";
@@ -1186,6 +1342,27 @@ void BulletDiceGL::calcQuad()
     }
 }
 
+void BulletDiceGL::uploadQuad()
+{
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, cornerVerts.size() * sizeof(float), cornerVerts.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(9 * sizeof(float)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    cornerVerts.clear();
+    cornerVerts.shrink_to_fit();
+}
+
 void BulletDiceGL::printMat4(mat4 matVal)
 {
     cout << "  4x4 Matrix\n\t";